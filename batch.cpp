@@ -0,0 +1,448 @@
+////////////////////////////////////////////////////////////////////////
+//
+//   cuberunner-batch: plays many independent seeded games headless on
+//   every core and prints how long each one survived, or with --json the
+//   survival and decision-time statistics of every mode and policy.
+//
+////////////////////////////////////////////////////////////////////////
+
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <vector>
+#include <memory>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <new>
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+#ifdef _WIN32
+#   include <malloc.h>
+#endif
+#ifdef __linux__
+#   include <pthread.h>
+#   include <sched.h>
+#endif
+
+#include "gameworld.h"
+#include "inputlog.h"
+#include "gameclock.h"
+#include "planner.h"
+#include "histogram.h"
+
+using namespace std;
+
+// G L O B A L S ///////////////////////////////////////////////////
+
+static const size_t g_cacheLineSize = 64;
+
+enum BatchMode { MODE_TUTORIAL, MODE_NORMAL, MODE_DEATH, NUM_MODES };
+enum BatchPolicy { POLICY_AUTONOMOUS, POLICY_REPLAY, POLICY_PLANNER, NUM_POLICIES };
+
+static const char* const g_modeNames[NUM_MODES] = {"tutorial", "normal", "death"};
+static const char* const g_policyNames[NUM_POLICIES] = {"autonomous", "replay", "planner"};
+static const GameCommand g_modeCommands[NUM_MODES] = {
+  GAME_COMMAND_TUTORIAL_MODE, GAME_COMMAND_NORMAL_MODE, GAME_COMMAND_DEATH_MODE
+};
+
+// command-line options; games cycle through the modes, then the policies, by game index
+static long long g_games = 1000;
+static unsigned long long g_firstSeed = 1;
+static long long g_seeds = 0;                                    // --seeds M: every mode and policy plays seeds S to S+M-1
+static vector<int> g_modes;                                      // all of them unless --mode is given
+static vector<int> g_policies(1, POLICY_AUTONOMOUS);
+static bool g_json = false;
+static const char* g_inputFile = NULL;
+static long long g_maxTicks = 0;                                 // 0 for an hour of play at the tick rate
+static int g_tickRate = g_simulationsPerSecond;
+static int g_threads = 0;                                        // 0 uses every core
+static unique_ptr<const PatternLibrary> g_patterns;              // --patterns FILE, shared read-only by every worker
+static Planner::Options g_plannerOptions;                        // for every worker's planner, 1 search thread unless given
+
+static vector<GameInput> g_replayInputs; // tick inputs of --input, played in a loop by the replay policy
+
+// Outcome of one game
+struct GameResult {
+  unsigned long long seed;
+  int mode;
+  int policy;
+  long long ticks;          // ticks survived
+  bool collided;            // false if the game reached g_maxTicks
+  long long truncatedPlans; // planner searches cut short by --planner-budget
+};
+
+static bool usesPlanner() {
+  return find(g_policies.begin(), g_policies.end(), (int)POLICY_PLANNER) != g_policies.end();
+}
+
+// Everything a worker touches per tick. Each worker allocates its own on its
+// own thread, so the pages are first touched (and on NUMA machines placed) on
+// the node the worker runs on, and cache-line alignment keeps two workers from
+// ever writing to the same line.
+struct alignas(g_cacheLineSize) Worker {
+  GameWorld world;
+  shared_ptr<Planner> planner; // only when the planner policy is played, so other policies start no search threads
+  LatencyHistogram decisionTimes[NUM_MODES][NUM_POLICIES]; // filled with --json
+
+  Worker() {
+    if (usesPlanner()) {
+      planner.reset(new Planner(g_plannerOptions));
+    }
+  }
+};
+
+///////////////// HELPER FUNCTIONS //////////////////////////////////////////////////
+
+static Worker* newWorker() {
+  void* p = NULL;
+#ifdef _WIN32
+  p = _aligned_malloc(sizeof(Worker), g_cacheLineSize);
+#else
+  if (posix_memalign(&p, g_cacheLineSize, sizeof(Worker)) != 0)
+    p = NULL;
+#endif
+  if (!p)
+    throw bad_alloc();
+  return new (p) Worker();
+}
+
+static void deleteWorker(Worker* worker) {
+  worker->~Worker();
+#ifdef _WIN32
+  _aligned_free(worker);
+#else
+  free(worker);
+#endif
+}
+
+// keeps the calling thread, and the threads it starts later, on count
+// cores from first on, so its memory stays local
+static void pinToCores(const int first, const int count) {
+#ifdef __linux__
+  const int hw = max(1, (int)thread::hardware_concurrency());
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  for (int i = 0; i < min(count, hw); ++i) {
+    CPU_SET((first + i) % hw, &cpus);
+  }
+  pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+#else
+  (void)first;
+  (void)count;
+#endif
+}
+
+static GameResult playGame(Worker& worker, const long long game) {
+  GameWorld& world = worker.world;
+  GameResult result;
+  const long long numModes = g_modes.size(), numPolicies = g_policies.size();
+  result.seed = g_firstSeed + (g_seeds > 0 ? game / (numModes * numPolicies) : game);
+  result.mode = g_modes[game % numModes];
+  result.policy = g_policies[(game / numModes) % numPolicies];
+  result.collided = false;
+  result.truncatedPlans = 0;
+
+  world.setSimulationsPerSecond(g_tickRate);
+  world.reset(result.seed);
+  world.applyCommand(g_modeCommands[result.mode]);
+  world.setAutonomous(result.policy != POLICY_REPLAY);
+  world.setPlanner(result.policy == POLICY_PLANNER ? worker.planner.get() : NULL);
+  const long long truncatedBefore = worker.planner ? worker.planner->getTruncatedPlans() : 0;
+  world.setDecisionTimes(g_json ? &worker.decisionTimes[result.mode][result.policy] : NULL);
+
+  const GameInput idle;
+  const long long numInputs = g_replayInputs.size();
+  for (long long tick = 0; tick < g_maxTicks; ++tick) {
+    const GameInput& input = result.policy == POLICY_REPLAY ? g_replayInputs[tick % numInputs] : idle;
+    if (world.step(input) & GAME_EVENT_COLLISION) {
+      result.collided = true;
+      break;
+    }
+  }
+  result.ticks = world.getTicks();
+  if (result.policy == POLICY_PLANNER) {
+    result.truncatedPlans = worker.planner->getTruncatedPlans() - truncatedBefore;
+  }
+  return result;
+}
+
+// worker thread: plays games until none are left, then adds its decision
+// times to those of every mode and policy
+static void runWorker(const int index, atomic<long long>* nextGame, vector<GameResult>* results,
+                      vector<LatencyHistogram>* decisionTimes) {
+  // a planner's search threads inherit the worker's cores, so it gets one for each
+  const int cores = usesPlanner() ? g_plannerOptions.threads : 1;
+  pinToCores(index * cores, cores);
+  Worker* worker = newWorker();
+  worker->world.setPatternLibrary(g_patterns.get());
+  for (long long game = (*nextGame)++; game < g_games; game = (*nextGame)++) {
+    (*results)[game] = playGame(*worker, game);
+  }
+  for (int mode = 0; mode < NUM_MODES; ++mode) {
+    for (int policy = 0; policy < NUM_POLICIES; ++policy) {
+      (*decisionTimes)[(index * NUM_MODES + mode) * NUM_POLICIES + policy] = worker->decisionTimes[mode][policy];
+    }
+  }
+  deleteWorker(worker);
+}
+
+// the indices of a comma-separated list of names, or of every name for "all"
+static vector<int> findNames(const char* const names[], const int count, const string& list) {
+  vector<int> found;
+  for (size_t begin = 0; begin <= list.size();) {
+    size_t end = list.find(',', begin);
+    if (end == string::npos) {
+      end = list.size();
+    }
+    const string name = list.substr(begin, end - begin);
+    int i = 0;
+    while (i < count && name != names[i]) {
+      ++i;
+    }
+    if (name == "all") {
+      for (int j = 0; j < count; ++j) {
+        found.push_back(j);
+      }
+    }
+    else if (i < count) {
+      found.push_back(i);
+    }
+    else {
+      throw runtime_error("Error: unknown mode or policy " + name);
+    }
+    begin = end + 1;
+  }
+  return found;
+}
+
+static void parseArgs(int argc, char * argv[]) {
+  for (int i = 1; i < argc; ++i) {
+    const string arg = argv[i];
+    if (arg == "--games" && i + 1 < argc) {
+      g_games = atoll(argv[++i]);
+    }
+    else if (arg == "--seed" && i + 1 < argc) {
+      g_firstSeed = strtoull(argv[++i], NULL, 10);
+    }
+    else if (arg == "--seeds" && i + 1 < argc) {
+      g_seeds = atoll(argv[++i]);
+    }
+    else if (arg == "--mode" && i + 1 < argc) {
+      g_modes = findNames(g_modeNames, NUM_MODES, argv[++i]);
+    }
+    else if (arg == "--policy" && i + 1 < argc) {
+      g_policies = findNames(g_policyNames, NUM_POLICIES, argv[++i]);
+    }
+    else if (arg == "--json") {
+      g_json = true;
+    }
+    else if (arg == "--input" && i + 1 < argc) {
+      g_inputFile = argv[++i];
+    }
+    else if (arg == "--max-ticks" && i + 1 < argc) {
+      g_maxTicks = atoll(argv[++i]);
+    }
+    else if (arg == "--threads" && i + 1 < argc) {
+      g_threads = atoi(argv[++i]);
+    }
+    else if (arg == "--tick-rate" && i + 1 < argc) {
+      g_tickRate = atoi(argv[++i]);
+    }
+    else if (arg == "--patterns" && i + 1 < argc) {
+      g_patterns.reset(new PatternLibrary(argv[++i]));
+    }
+    else if (arg == "--planner-beam" && i + 1 < argc) {
+      g_plannerOptions.beamWidth = atoi(argv[++i]);
+    }
+    else if (arg == "--planner-horizon" && i + 1 < argc) {
+      g_plannerOptions.horizonSeconds = (float)atof(argv[++i]);
+    }
+    else if (arg == "--planner-threads" && i + 1 < argc) {
+      g_plannerOptions.threads = atoi(argv[++i]);
+    }
+    else if (arg == "--planner-budget" && i + 1 < argc) {
+      g_plannerOptions.timeBudget = atof(argv[++i]) / 1000;
+    }
+    else {
+      throw runtime_error("Usage: cuberunner-batch [--games N | --seeds M] [--seed S] [--mode tutorial|normal|death|all,...]\n"
+                          "                        [--policy autonomous|replay|planner|all,...] [--input FILE]\n"
+                          "                        [--max-ticks T] [--threads K] [--patterns FILE] [--tick-rate HZ]\n"
+                          "                        [--planner-beam W] [--planner-horizon SECONDS] [--planner-threads K]\n"
+                          "                        [--planner-budget MS] [--json]");
+    }
+  }
+  if (g_modes.empty()) {
+    g_modes = findNames(g_modeNames, NUM_MODES, "all");
+  }
+  if (g_seeds > 0) {
+    g_games = g_seeds * (long long)(g_modes.size() * g_policies.size());
+  }
+  if (g_games <= 0 || g_seeds < 0 || g_maxTicks < 0)
+    throw runtime_error("Error: --games, --seeds and --max-ticks must be positive");
+  if (g_tickRate < g_minSimulationsPerSecond || g_tickRate > g_maxSimulationsPerSecond)
+    throw runtime_error("Error: --tick-rate must be between 20 and 1000");
+  if (g_plannerOptions.beamWidth < 1 ||
+      !(g_plannerOptions.horizonSeconds > 0 && g_plannerOptions.horizonSeconds <= g_maxPlannerHorizon))
+    throw runtime_error("Error: --planner-beam must be positive, and --planner-horizon from 0 to 10");
+  if (!(g_plannerOptions.timeBudget >= 0))
+    throw runtime_error("Error: --planner-budget must be 0 (no limit) or more");
+  if (g_maxTicks == 0) {
+    g_maxTicks = 60 * 60 * (long long)g_tickRate;
+  }
+  if (find(g_policies.begin(), g_policies.end(), (int)POLICY_REPLAY) != g_policies.end()) {
+    if (!g_inputFile)
+      throw runtime_error("Error: the replay policy needs --input FILE (a --record log)");
+    loadTickInputs(g_inputFile, g_replayInputs);
+    if (g_replayInputs.empty())
+      throw runtime_error("Error: the --input log has no ticks");
+  }
+  if (g_threads <= 0) {
+    g_threads = max(1, (int)thread::hardware_concurrency());
+  }
+  if (g_plannerOptions.threads <= 0) {
+    // every game already has a core's worth of threads, so a planner gets its share of what is left
+    g_plannerOptions.threads = max(1, (int)thread::hardware_concurrency() / g_threads);
+  }
+}
+
+static void printResults(const vector<GameResult>& results, const double seconds) {
+  cout << "game seed mode policy ticks survival_seconds collided" << endl;
+  vector<long long> survival(results.size());
+  long long totalTicks = 0, collisions = 0, truncatedPlans = 0;
+  for (size_t i = 0; i < results.size(); ++i) {
+    const GameResult& r = results[i];
+    truncatedPlans += r.truncatedPlans;
+    cout << i << " " << r.seed << " " << g_modeNames[r.mode] << " " << g_policyNames[r.policy] << " "
+         << r.ticks << " " << (double)r.ticks / g_tickRate << " " << (r.collided ? 1 : 0) << endl;
+    survival[i] = r.ticks;
+    totalTicks += r.ticks;
+    collisions += r.collided;
+  }
+  sort(survival.begin(), survival.end());
+
+  const double n = results.size();
+  cout << "# games " << results.size() << ", threads " << g_threads << ", collided " << collisions << endl;
+  cout << "# survival seconds: min " << survival.front() / (double)g_tickRate
+       << ", median " << survival[survival.size() / 2] / (double)g_tickRate
+       << ", mean " << totalTicks / n / g_tickRate
+       << ", max " << survival.back() / (double)g_tickRate << endl;
+  if (g_plannerOptions.timeBudget > 0) {
+    cout << "# planner searches cut short by --planner-budget: " << truncatedPlans << endl;
+  }
+  cout << "# ticks " << totalTicks << ", wall time " << seconds << " seconds";
+  if (seconds > 0) {
+    cout << " (" << totalTicks / seconds << " ticks/s)";
+  }
+  cout << endl;
+}
+
+// the value at fraction p of the way through sorted values, by nearest rank
+static long long percentile(const vector<long long>& sorted, const double p) {
+  const long long rank = (long long)ceil(p * sorted.size());
+  return sorted[min(max(rank, 1LL), (long long)sorted.size()) - 1];
+}
+
+// Prints one object per mode and policy that was played: survival percentiles,
+// collisions per minute of play, the decision time per tick and every game's
+// survival in ticks in seed order, so two runs can be compared seed by seed.
+// Decision times are spread over all the games and count every tick the
+// runner was steered, by the autopilot or the planner.
+static void printJson(const vector<GameResult>& results, const double seconds,
+                      const vector<LatencyHistogram>& decisionTimes) {
+  static const double g_survivalPercentiles[] = {0, .1, .25, .5, .75, .9, .99, 1};
+  static const char* const g_survivalNames[] = {"min", "p10", "p25", "median", "p75", "p90", "p99", "max"};
+
+  long long totalTicks = 0;
+  for (size_t i = 0; i < results.size(); ++i) {
+    totalTicks += results[i].ticks;
+  }
+  cout << "{\n"
+       << "  \"games\": " << results.size() << ",\n"
+       << "  \"first_seed\": " << g_firstSeed << ",\n"
+       << "  \"tick_rate\": " << g_tickRate << ",\n"
+       << "  \"max_ticks\": " << g_maxTicks << ",\n"
+       << "  \"threads\": " << g_threads << ",\n"
+       << "  \"planner_budget_ms\": " << g_plannerOptions.timeBudget * 1000 << ",\n"
+       << "  \"wall_seconds\": " << seconds << ",\n"
+       << "  \"ticks_per_second\": " << (seconds > 0 ? totalTicks / seconds : 0) << ",\n"
+       << "  \"groups\": [";
+
+  bool firstGroup = true;
+  for (size_t p = 0; p < g_policies.size(); ++p) {
+    for (size_t m = 0; m < g_modes.size(); ++m) {
+      const int mode = g_modes[m], policy = g_policies[p];
+      vector<long long> survival;
+      long long ticks = 0, collisions = 0, truncatedPlans = 0;
+      for (size_t i = 0; i < results.size(); ++i) {
+        const GameResult& r = results[i];
+        if (r.mode != mode || r.policy != policy)
+          continue;
+        survival.push_back(r.ticks);
+        ticks += r.ticks;
+        collisions += r.collided;
+        truncatedPlans += r.truncatedPlans;
+      }
+      if (survival.empty())
+        continue;
+      LatencyHistogram times;
+      for (int t = 0; t < g_threads; ++t) {
+        times.merge(decisionTimes[(t * NUM_MODES + mode) * NUM_POLICIES + policy]);
+      }
+
+      cout << (firstGroup ? "\n" : ",\n") << "    {\n"
+           << "      \"mode\": \"" << g_modeNames[mode] << "\",\n"
+           << "      \"policy\": \"" << g_policyNames[policy] << "\",\n"
+           << "      \"games\": " << survival.size() << ",\n"
+           << "      \"collided\": " << collisions << ",\n"
+           << "      \"collisions_per_minute\": " << (ticks > 0 ? collisions / (ticks / (60.0 * g_tickRate)) : 0) << ",\n"
+           << "      \"survival_seconds\": {";
+      firstGroup = false;
+      vector<long long> sorted = survival;
+      sort(sorted.begin(), sorted.end());
+      for (size_t k = 0; k < sizeof(g_survivalPercentiles) / sizeof(g_survivalPercentiles[0]); ++k) {
+        cout << "\"" << g_survivalNames[k] << "\": " << (double)percentile(sorted, g_survivalPercentiles[k]) / g_tickRate << ", ";
+      }
+      cout << "\"mean\": " << (double)ticks / survival.size() / g_tickRate << "},\n"
+           << "      \"decision_microseconds\": {\"ticks\": " << times.count()
+           << ", \"mean\": " << times.mean() * 1e6 << ", \"p99\": " << times.percentile(.99) * 1e6 << "},\n"
+           << "      \"truncated_plans\": " << truncatedPlans << ",\n"
+           << "      \"survival_ticks\": [";
+      for (size_t i = 0; i < survival.size(); ++i) {
+        cout << (i ? ", " : "") << survival[i];
+      }
+      cout << "]\n    }";
+    }
+  }
+  cout << "\n  ]\n}" << endl;
+}
+
+int main(int argc, char * argv[]) {
+  try {
+    parseArgs(argc, argv);
+
+    vector<GameResult> results(g_games);
+    vector<LatencyHistogram> decisionTimes(g_threads * NUM_MODES * NUM_POLICIES);
+    atomic<long long> nextGame(0);
+    const double begin = getMonotonicSeconds();
+    vector<thread> threads;
+    for (int i = 0; i < g_threads; ++i) {
+      threads.push_back(thread(runWorker, i, &nextGame, &results, &decisionTimes));
+    }
+    for (int i = 0; i < g_threads; ++i) {
+      threads[i].join();
+    }
+    if (g_json) {
+      printJson(results, getMonotonicSeconds() - begin, decisionTimes);
+    }
+    else {
+      printResults(results, getMonotonicSeconds() - begin);
+    }
+    return 0;
+  }
+  catch (const exception& e) {
+    cout << "Exception caught: " << e.what() << endl;
+    return -1;
+  }
+}
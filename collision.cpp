@@ -0,0 +1,180 @@
+#include <cstring>
+
+#include "collision.h"
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#   define CUBERUNNER_X86_DISPATCH 1
+#   include <immintrin.h>
+#endif
+
+// Each kernel ORs its hit bits into mask, which the caller has zeroed, and
+// leaves the elements past the last full vector to the scalar tail.
+
+static int boxHitsScalar(const float* x, const float* y, const float* z, int begin, int n, const HitBox& box, unsigned* mask) {
+  int hits = 0;
+  for (int i = begin; i < n; ++i) {
+    const unsigned in = (x[i] > box.minX) & (x[i] < box.maxX) &
+                        (y[i] > box.minY) & (y[i] < box.maxY) &
+                        (z[i] > box.minZ) & (z[i] < box.maxZ);
+    mask[i >> 5] |= in << (i & 31);
+    hits += in;
+  }
+  return hits;
+}
+
+#ifdef CUBERUNNER_X86_DISPATCH
+
+__attribute__((target("sse,popcnt")))
+static int boxHitsSse(const float* x, const float* y, const float* z, int n, const HitBox& box, unsigned* mask) {
+  const __m128 minX = _mm_set1_ps(box.minX), maxX = _mm_set1_ps(box.maxX);
+  const __m128 minY = _mm_set1_ps(box.minY), maxY = _mm_set1_ps(box.maxY);
+  const __m128 minZ = _mm_set1_ps(box.minZ), maxZ = _mm_set1_ps(box.maxZ);
+  int hits = 0;
+  int i = 0;
+  for (; i + 4 <= n; i += 4) {
+    const __m128 cx = _mm_loadu_ps(x + i), cy = _mm_loadu_ps(y + i), cz = _mm_loadu_ps(z + i);
+    __m128 in = _mm_and_ps(_mm_cmpgt_ps(cx, minX), _mm_cmplt_ps(cx, maxX));
+    in = _mm_and_ps(in, _mm_and_ps(_mm_cmpgt_ps(cy, minY), _mm_cmplt_ps(cy, maxY)));
+    in = _mm_and_ps(in, _mm_and_ps(_mm_cmpgt_ps(cz, minZ), _mm_cmplt_ps(cz, maxZ)));
+    const unsigned bits = (unsigned)_mm_movemask_ps(in);
+    mask[i >> 5] |= bits << (i & 31);
+    hits += _mm_popcnt_u32(bits);
+  }
+  return hits + boxHitsScalar(x, y, z, i, n, box, mask);
+}
+
+__attribute__((target("avx2,popcnt")))
+static int boxHitsAvx2(const float* x, const float* y, const float* z, int n, const HitBox& box, unsigned* mask) {
+  const __m256 minX = _mm256_set1_ps(box.minX), maxX = _mm256_set1_ps(box.maxX);
+  const __m256 minY = _mm256_set1_ps(box.minY), maxY = _mm256_set1_ps(box.maxY);
+  const __m256 minZ = _mm256_set1_ps(box.minZ), maxZ = _mm256_set1_ps(box.maxZ);
+  int hits = 0;
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const __m256 cx = _mm256_loadu_ps(x + i), cy = _mm256_loadu_ps(y + i), cz = _mm256_loadu_ps(z + i);
+    __m256 in = _mm256_and_ps(_mm256_cmp_ps(cx, minX, _CMP_GT_OQ), _mm256_cmp_ps(cx, maxX, _CMP_LT_OQ));
+    in = _mm256_and_ps(in, _mm256_and_ps(_mm256_cmp_ps(cy, minY, _CMP_GT_OQ), _mm256_cmp_ps(cy, maxY, _CMP_LT_OQ)));
+    in = _mm256_and_ps(in, _mm256_and_ps(_mm256_cmp_ps(cz, minZ, _CMP_GT_OQ), _mm256_cmp_ps(cz, maxZ, _CMP_LT_OQ)));
+    const unsigned bits = (unsigned)_mm256_movemask_ps(in);
+    mask[i >> 5] |= bits << (i & 31);
+    hits += _mm_popcnt_u32(bits);
+  }
+  _mm256_zeroupper(); // the compiler does not insert this for target() functions
+  return hits + boxHitsScalar(x, y, z, i, n, box, mask);
+}
+
+__attribute__((target("avx512f,avx,popcnt")))
+static int boxHitsAvx512(const float* x, const float* y, const float* z, int n, const HitBox& box, unsigned* mask) {
+  const __m512 minX = _mm512_set1_ps(box.minX), maxX = _mm512_set1_ps(box.maxX);
+  const __m512 minY = _mm512_set1_ps(box.minY), maxY = _mm512_set1_ps(box.maxY);
+  const __m512 minZ = _mm512_set1_ps(box.minZ), maxZ = _mm512_set1_ps(box.maxZ);
+  int hits = 0;
+  int i = 0;
+  for (; i + 16 <= n; i += 16) {
+    const __m512 cx = _mm512_loadu_ps(x + i), cy = _mm512_loadu_ps(y + i), cz = _mm512_loadu_ps(z + i);
+    __mmask16 in = _mm512_cmp_ps_mask(cx, minX, _CMP_GT_OQ) & _mm512_cmp_ps_mask(cx, maxX, _CMP_LT_OQ);
+    in &= _mm512_cmp_ps_mask(cy, minY, _CMP_GT_OQ) & _mm512_cmp_ps_mask(cy, maxY, _CMP_LT_OQ);
+    in &= _mm512_cmp_ps_mask(cz, minZ, _CMP_GT_OQ) & _mm512_cmp_ps_mask(cz, maxZ, _CMP_LT_OQ);
+    const unsigned bits = (unsigned)in;
+    mask[i >> 5] |= bits << (i & 31);
+    hits += _mm_popcnt_u32(bits);
+  }
+  _mm256_zeroupper();
+  return hits + boxHitsScalar(x, y, z, i, n, box, mask);
+}
+
+#endif
+
+typedef int (*BoxHitsKernel)(const float*, const float*, const float*, int, const HitBox&, unsigned*);
+
+static int boxHitsPortable(const float* x, const float* y, const float* z, int n, const HitBox& box, unsigned* mask) {
+  return boxHitsScalar(x, y, z, 0, n, box, mask);
+}
+
+// Batches shorter than this go to the narrower small-batch kernel: waking the
+// 512-bit units costs more than a lane or grid cell of a few cubes saves.
+static const int WIDE_KERNEL_MIN_BATCH = 64;
+
+// the kernels for this CPU and the name of the widest one's instruction set
+struct BoxHitsKernels {
+  BoxHitsKernel wide;
+  BoxHitsKernel small;
+  const char* isa;
+};
+
+// picks the widest kernel the CPU supports, and the widest below AVX-512 for small batches
+static BoxHitsKernels selectKernels() {
+  BoxHitsKernels k = {boxHitsPortable, boxHitsPortable, "scalar"};
+#ifdef CUBERUNNER_X86_DISPATCH
+  __builtin_cpu_init();
+  // every vector kernel counts hits with popcnt
+  if (__builtin_cpu_supports("popcnt")) {
+    if (__builtin_cpu_supports("avx2")) {
+      k.wide = boxHitsAvx2;
+      k.isa = "avx2";
+    }
+    else if (__builtin_cpu_supports("sse")) {
+      k.wide = boxHitsSse;
+      k.isa = "sse";
+    }
+    k.small = k.wide;
+    if (__builtin_cpu_supports("avx512f")) {
+      k.wide = boxHitsAvx512;
+      k.isa = "avx512";
+    }
+  }
+#endif
+  return k;
+}
+
+// chosen on the first call, so a caller in another file's static initializer
+// never finds them unset; C++11 makes that first call thread-safe
+static const BoxHitsKernels& boxHitsKernels() {
+  static const BoxHitsKernels kernels = selectKernels();
+  return kernels;
+}
+
+int boxHitMask(const float* x, const float* y, const float* z, int n, const HitBox& box, unsigned* mask) {
+  if (n <= 0)
+    return 0;
+  memset(mask, 0, sizeof(unsigned) * ((n + 31) / 32));
+  const BoxHitsKernels& kernels = boxHitsKernels();
+  if (n < WIDE_KERNEL_MIN_BATCH)
+    return kernels.small(x, y, z, n, box, mask);
+  return kernels.wide(x, y, z, n, box, mask);
+}
+
+int firstBoxHit(const float* x, const float* y, const float* z, int n, const HitBox& box) {
+  static const int CHUNK = 256;
+  unsigned mask[CHUNK / 32];
+  for (int begin = 0; begin < n; begin += CHUNK) {
+    const int count = n - begin < CHUNK ? n - begin : CHUNK;
+    if (boxHitMask(x + begin, y + begin, z + begin, count, box, mask) == 0)
+      continue;
+    for (int w = 0; w < (count + 31) / 32; ++w) {
+      if (mask[w] == 0)
+        continue;
+      int bit = 0;
+      while (!((mask[w] >> bit) & 1)) {
+        ++bit;
+      }
+      return begin + 32 * w + bit;
+    }
+  }
+  return -1;
+}
+
+int countBoxHits(const float* x, const float* y, const float* z, int n, const HitBox& box) {
+  static const int CHUNK = 256;
+  unsigned mask[CHUNK / 32];
+  int hits = 0;
+  for (int begin = 0; begin < n; begin += CHUNK) {
+    const int count = n - begin < CHUNK ? n - begin : CHUNK;
+    hits += boxHitMask(x + begin, y + begin, z + begin, count, box, mask);
+  }
+  return hits;
+}
+
+const char* boxHitIsa() {
+  return boxHitsKernels().isa;
+}
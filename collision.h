@@ -0,0 +1,84 @@
+#ifndef COLLISION_H
+#define COLLISION_H
+
+// Batched point-in-box tests over structure-of-arrays cube centers.
+//
+// The kernels have SSE, AVX2 and AVX-512 variants, each counting hits with
+// popcnt. The widest one the CPU supports is picked with cpuid on the first
+// call, so the kernels can be used from any static initializer; other
+// compilers and CPUs use the scalar version.
+
+// An open box: a center (x, y, z) is inside if minX < x < maxX, and so on
+struct HitBox {
+  float minX, maxX;
+  float minY, maxY;
+  float minZ, maxZ;
+};
+
+// Makes the box of the given half extents around (x, y, z)
+inline HitBox makeHitBox(const float x, const float y, const float z,
+                         const float halfWidth, const float halfHeight, const float halfDepth) {
+  HitBox box = {x - halfWidth, x + halfWidth, y - halfHeight, y + halfHeight, z - halfDepth, z + halfDepth};
+  return box;
+}
+
+// The smallest box containing both a and b
+inline HitBox boxUnion(const HitBox& a, const HitBox& b) {
+  HitBox box = {a.minX < b.minX ? a.minX : b.minX, a.maxX > b.maxX ? a.maxX : b.maxX,
+                a.minY < b.minY ? a.minY : b.minY, a.maxY > b.maxY ? a.maxY : b.maxY,
+                a.minZ < b.minZ ? a.minZ : b.minZ, a.maxZ > b.maxZ ? a.maxZ : b.maxZ};
+  return box;
+}
+
+// Returns true if (x, y, z) is strictly inside the box at some moment as it
+// slides in a straight line from `from` to `to` (boxes of the same size).
+// The swept bounds are checked on every axis; when more than one axis moves
+// the times at which each axis contains the point must also overlap. With a
+// single moving axis this is exactly the test against the swept bounds.
+inline bool sweptBoxContains(const HitBox& from, const HitBox& to, const float x, const float y, const float z) {
+  const float p[3] = {x, y, z};
+  const float lo0[3] = {from.minX, from.minY, from.minZ}, hi0[3] = {from.maxX, from.maxY, from.maxZ};
+  const float lo1[3] = {to.minX, to.minY, to.minZ}, hi1[3] = {to.maxX, to.maxY, to.maxZ};
+  float tEnter = 0, tExit = 1;
+  int moving = 0;
+  for (int axis = 0; axis < 3; ++axis) {
+    const float lo = lo0[axis] < lo1[axis] ? lo0[axis] : lo1[axis];
+    const float hi = hi0[axis] > hi1[axis] ? hi0[axis] : hi1[axis];
+    if (!(p[axis] > lo && p[axis] < hi))
+      return false;
+    const float d = lo1[axis] - lo0[axis];
+    if (d == 0)
+      continue;
+    ++moving;
+    // times at which the moving slab's two faces pass the point
+    float t0 = (p[axis] - hi0[axis]) / d, t1 = (p[axis] - lo0[axis]) / d;
+    if (d < 0) {
+      const float t = t0;
+      t0 = t1;
+      t1 = t;
+    }
+    if (t0 > tEnter) {
+      tEnter = t0;
+    }
+    if (t1 < tExit) {
+      tExit = t1;
+    }
+  }
+  return moving < 2 || tEnter < tExit;
+}
+
+// Sets bit (i % 32) of mask[i / 32] for every center i in [0, n) that lies in
+// the box and clears the others. mask must hold (n + 31) / 32 words.
+// Returns the number of hits.
+int boxHitMask(const float* x, const float* y, const float* z, int n, const HitBox& box, unsigned* mask);
+
+// Returns the index of the first center in the box, or -1 if there is none
+int firstBoxHit(const float* x, const float* y, const float* z, int n, const HitBox& box);
+
+// Returns the number of centers in the box
+int countBoxHits(const float* x, const float* y, const float* z, int n, const HitBox& box);
+
+// Name of the instruction set the kernels dispatched to, printed by --headless
+const char* boxHitIsa();
+
+#endif
@@ -0,0 +1,122 @@
+#ifndef CUBEGRID_H
+#define CUBEGRID_H
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+#include "collision.h"
+
+// Broad-phase index of the cube field: a uniform grid over world x and
+// stored z (the scroll-independent z kept by CubeStore), so a cube stays in
+// one cell for its whole life. Rows and columns are indexed modulo the grid
+// size, which lets the grid slide along with the field as the world scrolls
+// and the player strafes without ever being rebuilt; cubes far away that
+// alias into the same cell are rejected by the exact test.
+class CubeGrid {
+public:
+  static const int NUM_ROWS = 64; // z cells, must be a power of two
+  static const int NUM_COLS = 64; // x cells, must be a power of two
+
+  // cell dimensions should be at least the size of the runner box, so that a
+  // tick's sweep in sweepHits() only covers a few cells
+  CubeGrid(const float cellWidth, const float cellDepth)
+    : cellWidth_(cellWidth), cellDepth_(cellDepth), cells_(NUM_ROWS * NUM_COLS), topRow_(0) {
+    for (int i = 0; i < NUM_ROWS * NUM_COLS; ++i) {
+      cells_[i].x.reserve(4);
+      cells_[i].y.reserve(4);
+      cells_[i].z.reserve(4);
+    }
+  }
+
+  // removes every cube; zLimit is the stored z past which cubes are despawned
+  void clear(const float zLimit) {
+    for (int i = 0; i < NUM_ROWS * NUM_COLS; ++i) {
+      cells_[i].clear();
+    }
+    topRow_ = row(zLimit);
+  }
+
+  void insert(const float x, const float y, const float z) {
+    const int r = row(z);
+    if (r > topRow_) {
+      topRow_ = r;
+    }
+    Cell& c = cell(r, col(x));
+    c.x.push_back(x);
+    c.y.push_back(y);
+    c.z.push_back(z);
+  }
+
+  // drops the rows entirely past zLimit. Cubes past zLimit in the row that
+  // straddles it stay until that row is dropped, which is harmless as long as
+  // the queried boxes stay a cell away from zLimit. No more than NUM_ROWS rows
+  // are cleared, since past that they would wrap round onto rows already done.
+  void despawnFrom(const float zLimit) {
+    const int limitRow = row(zLimit);
+    topRow_ = std::min(topRow_, limitRow + int(NUM_ROWS));
+    for (; topRow_ > limitRow; --topRow_) {
+      for (int c = 0; c < NUM_COLS; ++c) {
+        cell(topRow_, c).clear();
+      }
+    }
+  }
+
+  // returns true if some cube center is inside the box at some moment as it
+  // slides from `from` to `to` (see sweptBoxContains)
+  bool sweepHits(const HitBox& from, const HitBox& to) const {
+    // the bounds of the sweep select the candidates for the exact test
+    const HitBox bounds = boxUnion(from, to);
+
+    unsigned mask[(MAX_CELL_BATCH + 31) / 32];
+    const int c0 = col(bounds.minX), c1 = col(bounds.maxX);
+    const int r0 = row(bounds.minZ), r1 = row(bounds.maxZ);
+    for (int r = r0; r <= r1; ++r) {
+      for (int c = c0; c <= c1; ++c) {
+        const Cell& cl = cell(r, c);
+        const int n = (int)cl.z.size();
+        for (int begin = 0; begin < n; begin += MAX_CELL_BATCH) {
+          const int count = std::min(n - begin, int(MAX_CELL_BATCH));
+          if (boxHitMask(&cl.x[begin], &cl.y[begin], &cl.z[begin], count, bounds, mask) == 0)
+            continue;
+          for (int i = 0; i < count; ++i) {
+            if (((mask[i >> 5] >> (i & 31)) & 1) &&
+                sweptBoxContains(from, to, cl.x[begin + i], cl.y[begin + i], cl.z[begin + i]))
+              return true;
+          }
+        }
+      }
+    }
+    return false;
+  }
+
+private:
+  static const int MAX_CELL_BATCH = 64; // cubes per boxHitMask call in sweepHits
+
+  // cube centers of one cell, laid out for the batched box test
+  struct Cell {
+    std::vector<float> x, y, z;
+
+    void clear() {
+      x.clear();
+      y.clear();
+      z.clear();
+    }
+  };
+
+  int row(const float z) const { return (int)std::floor(z / cellDepth_); }
+  int col(const float x) const { return (int)std::floor(x / cellWidth_); }
+
+  Cell& cell(const int r, const int c) {
+    return cells_[(r & (NUM_ROWS - 1)) * NUM_COLS + (c & (NUM_COLS - 1))];
+  }
+  const Cell& cell(const int r, const int c) const {
+    return cells_[(r & (NUM_ROWS - 1)) * NUM_COLS + (c & (NUM_COLS - 1))];
+  }
+
+  float cellWidth_, cellDepth_;
+  std::vector<Cell> cells_;
+  int topRow_; // highest row that may hold cubes
+};
+
+#endif
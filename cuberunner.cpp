@@ -11,9 +11,10 @@
 #include <string>
 #include <memory>
 #include <stdexcept>
-#if __GNUG__
-#   include <tr1/memory>
-#endif
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
 
 #ifdef __MAC__
 #   include <OpenGL/gl3.h>
@@ -30,9 +31,15 @@
 #include "geometrymaker.h"
 #include "ppm.h"
 #include "glsupport.h"
+#include "gameworld.h"
+#include "collision.h"
+#include "planner.h"
+#include "inputlog.h"
+#include "rewind.h"
+#include "gameclock.h"
+#include "triplebuffer.h"
 
-using namespace std; // for string, vector, iostream, and other standard C++ stuff
-using namespace tr1; // for shared_ptr
+using namespace std; // for string, vector, iostream, shared_ptr, and other standard C++ stuff
 
 // G L O B A L S ///////////////////////////////////////////////////
 
@@ -61,56 +68,72 @@ static float g_frustFovY = g_frustMinFov; // FOV in y direction (updated by upda
 static const float g_frustNear = -0.1;    // near plane
 static const float g_frustFar = -50.0;    // far plane
 static const float g_groundSize = 10.0;   // half the ground length
-static const float g_groundY = -.05;      // y coordinate of the ground
-static const float g_cubeSideLength = .22;
-static const float g_runnerZ = 3.5;
-static float g_groundX = 0; // x coordinate of ground
 
 // gameplay variables
-//static int g_numCubes = 0;
-static float g_cubeFieldLeftSide = -2;
-static float g_cubeFieldWidth = g_windowHeight / 128.0;
-static const float g_furthestCubeZ = -3.0;
-static const float g_nearestCubeZ = 1.0;
-static const float g_zRange = g_nearestCubeZ - g_furthestCubeZ;
 static bool g_leftDown = false;
 static bool g_rightDown = false;
-static const float g_xTranslationAmount = .05;
-static const float g_maxRotationAngle = 35; // max screen tilt angle in degrees
-static const float g_sinHalfMaxRotationAngle = sin(0.5 * g_maxRotationAngle * CS175_PI/180);
-
-// simulation constants
-static const int g_simulationsPerSecond = 40;
-static const int g_simRateOriginal = 5;
-static const int g_simRateLowBound = 2;
-static const float g_cubeIncrDisMin = .06;
-static const float g_cubeIncrDisMax = .1;
-
-// simulation variables
-static int g_simCount = -1; // counts simulations (cycles through 3*g_simulationsPerCubeGen*g_simulationsPerSecond)
-static int g_simulationsPerCubeGen = g_simRateOriginal; // number of simulations that pass for each generated cube
-static float g_secondsPerLevel = 5.0; // number of seconds that pass before speed increases in tutorial mode or color changes in normal gameplay mode
-static float g_cubeIncrDis = g_cubeIncrDisMin; // the distance each cube moves for each simulaiton (each call to runCubes)
-static bool g_gameOn = true; // indicates whether the game has been paused after a collision
+static bool g_jumpDown = false; // jump pressed since the last simulation
 static bool g_gamePaused = false; // indicates whether the game has been paused after the 'p' key is pressed
 
-// game modes
-static bool g_tutorialMode = true; // tutorial mode (where the game begins)
-static bool g_rgbCubesMode = false; // normal gameplay mode
-static bool g_deathMode = false; // death mode
-
-static bool g_autonomous = false; // AI plays game
-
-// jump vairables
-static const float g_jumpPeak = g_cubeSideLength + .5; // high enough to jump over a cube
-static float g_jumpHeight = 0.0; // indicates current jump height
-static float g_jumpAmount = .1;
-static bool g_jumpInProgress = false;
-static bool g_jumpPeakReached = false;
+static GameWorld g_world; // all simulation state
+
+// What drawStuff() needs of the world as of one tick: the values at that tick
+// and at the one before, to interpolate frames drawn in between
+struct WorldFrame {
+  PlayerPose prevPose, pose;             // camera and runner, built into transforms when drawn
+  float prevGroundX, groundX, prevScroll, scroll;
+  float prevSpin, spin;                 // spin of a cube spawned on tick 0
+  float spinPerTick;
+  vector<float> x, y, z;                // cubes of every layer
+  vector<int> spawnTick;
+  vector<unsigned> color;
+  bool rgbCubesMode, deathMode;
+  bool advancing;                       // more ticks are coming, so interpolate
+  double tickTime;                      // getMonotonicSeconds() the tick was due at
+};
 
-static int g_cyclesRequiredToClearCube = ceil((.5 * g_cubeSideLength) / g_xTranslationAmount);
-static int g_minCyclesRequiredToJumpCube = ceil(g_cubeSideLength / g_jumpAmount);
-static int g_maxCyclesRequiredToJumpCube = ceil(g_jumpPeak / g_jumpAmount);
+// The simulation runs on its own thread at a fixed g_tickRate ticks per second of
+// monotonic time. g_worldMutex guards the world and the input and pause state
+// it shares with the GLUT callbacks. After every tick, and every change made
+// from a callback, the world is copied into a WorldFrame and published; the
+// publishers take turns under the mutex. display() draws the newest frame
+// without locking, so a slow frame never delays a tick or the other way round.
+static int g_tickRate = g_simulationsPerSecond; // --tick-rate HZ, set before the thread starts
+static const double g_maxFrameSeconds = .25; // longest stall that is caught up on; the rest is dropped
+static mutex g_worldMutex;
+static condition_variable g_simulationWake;  // the game resumed or the program is quitting
+static thread g_simulationThread;
+static bool g_quitting = false;
+static bool g_redrawing = false;             // idle callback installed
+static TripleBuffer<WorldFrame> g_frames;
+
+// headless mode (--headless --ticks N) runs the simulation with no window or GL context
+static bool g_headless = false;
+static long long g_headlessTicks = 0;
+
+// --record FILE logs every tick and command; --replay FILE plays such a log back headless
+static const char* g_recordFile = NULL;
+static const char* g_replayFile = NULL;
+static shared_ptr<InputRecorder> g_recorder;
+
+// rewinding with ',' '.' '<' '>'; a recording can't follow a rewind, so there is none while recording
+static const int g_rewindKeyframes = 10 * 60; // keyframes are a second apart, so ten minutes of history
+static shared_ptr<RewindBuffer> g_rewind;
+
+// draws cubes ahead of the simulation thread in the windowed game
+static shared_ptr<SpawnPregenerator> g_spawner;
+
+// --patterns FILE fills the field with the chunks of a pattern library
+static shared_ptr<PatternLibrary> g_patterns;
+
+// --planner has the autonomous player search ahead instead of using the autopilot;
+// --planner-beam, --planner-horizon and --planner-threads size its search, and
+// --planner-budget MS bounds the time it may take a tick. There is no bound
+// by default: a search cut short depends on the machine's timing, and rewinds
+// and replays rebuild the game by searching again.
+static bool g_usePlanner = false;
+static Planner::Options g_plannerOptions;
+static shared_ptr<Planner> g_planner;
 
 // mouse controls
 static bool g_mouseClickDown = false;    // is the mouse button pressed
@@ -250,16 +273,7 @@ struct Geometry {
 static shared_ptr<Geometry> g_ground, g_runner, g_cube;
 
 // --------- Scene
-static float g_light1X = 0.0;
-static float g_light2X = 0.0;
-static const Cvec3 g_light1(g_light1X, 3.0, 14.0), g_light2(g_light2X, 3.0, -1.0);  // define two lights positions in world space
-static const RigTForm g_originalSkyRbt = RigTForm(Cvec3(0.0, 0.25, 4.0));
-static RigTForm g_skyRbt = g_originalSkyRbt; // camera
-static RigTForm g_runnerRbt = RigTForm(); // runner
-
-static const int g_numLayers = 7;
-static deque<RigTForm> g_cubeRbt[g_numLayers]; // holds cubes
-static deque<Cvec3f> g_cubeColors[g_numLayers]; // holds cube colros
+static const Cvec3 g_light1(0.0, 3.0, 14.0), g_light2(0.0, 3.0, -1.0);  // define two lights positions in world space (x follows the ground)
 
 static Cvec3f g_runnerColor; // runner color
 
@@ -291,22 +305,78 @@ static void initRunner() {
 ///////////////// HELPER FUNCTIONS //////////////////////////////////////////////////
 
 static void printCubeXValues() {
-    for (int layer = 0; layer < g_numLayers; layer++) {
+    for (int layer = 0; layer < GameWorld::NUM_LAYERS; layer++) {
         cout << "LAYER " << layer << ":" << endl;
-        for (int i = 0; i < g_cubeRbt[layer].size(); i++) {
-            cout << "\t" << g_cubeRbt[layer][i].getTranslation()[0] << endl;
+        const CubeStore& cubes = g_world.getCubes(layer);
+        for (int i = 0; i < cubes.size(); i++) {
+            cout << "\t" << cubes.x()[i] << endl;
         }
     }
 }
 
-static void changeColors() {
+static void printCubeGenRate() {
+    cout << "Cubes generated per second: " << (int)(g_simulationsPerSecond/g_world.getSimulationsPerCubeGen()) << endl;
+}
+
+// copies the world into the next frame and publishes it; called with g_worldMutex held
+static void publishFrame(const double tickTime) {
+    WorldFrame& frame = g_frames.back();
+    frame.prevPose = g_world.getPose(0);
+    frame.pose = g_world.getPose(1);
+    frame.prevGroundX = g_world.getGroundX(0);
+    frame.groundX = g_world.getGroundX(1);
+    frame.prevScroll = g_world.getScroll(0);
+    frame.scroll = g_world.getScroll(1);
+    frame.prevSpin = g_world.getCubeSpin(0, 0);
+    frame.spin = g_world.getCubeSpin(0, 1);
+    frame.spinPerTick = g_world.getCubeSpinPerTick();
+    frame.x.clear();
+    frame.y.clear();
+    frame.z.clear();
+    frame.spawnTick.clear();
+    frame.color.clear();
+    for (int layer = 0; layer < GameWorld::NUM_LAYERS; layer++) {
+        const CubeStore& cubes = g_world.getCubes(layer);
+        const int n = cubes.size();
+        frame.x.insert(frame.x.end(), cubes.x(), cubes.x() + n);
+        frame.y.insert(frame.y.end(), cubes.y(), cubes.y() + n);
+        frame.z.insert(frame.z.end(), cubes.z(), cubes.z() + n);
+        frame.spawnTick.insert(frame.spawnTick.end(), cubes.spawnTick(), cubes.spawnTick() + n);
+        frame.color.insert(frame.color.end(), cubes.color(), cubes.color() + n);
+    }
+    frame.rgbCubesMode = g_world.isRgbCubesMode();
+    frame.deathMode = g_world.isDeathMode();
+    frame.advancing = g_world.isGameOn() && !g_gamePaused;
+    frame.tickTime = tickTime;
+    g_frames.publish();
+}
+
+// publishes a change made between ticks, drawn as is until the next tick
+static void publishChange() {
+    publishFrame(getMonotonicSeconds() - 1.0 / g_tickRate);
+}
+
+// applies a player command to the world, recording it first if requested
+static bool issueCommand(const GameCommand command, const float value = 0) {
+    if (g_recorder) {
+        g_recorder->recordCommand(command, value);
+    }
+    const bool applied = g_rewind ? g_rewind->applyCommand(g_world, command, value)
+                                  : g_world.applyCommand(command, value);
+    if (!g_headless) {
+        publishChange();
+    }
+    return applied;
+}
+
+static void changeColors(const WorldFrame& frame) {
     // RGB CUBES MODE
-    if (g_rgbCubesMode) {
+    if (frame.rgbCubesMode) {
         glClearColor(255/255., 255/255., 255/255., 0.); // white sky
         g_runnerColor = Cvec3f(108/255.0, 91/255.0, 5/255.0); // gold runner
     }
     // DEATH MODE
-    else if (g_deathMode) {
+    else if (frame.deathMode) {
         glClearColor(0/255., 0/255., 0/255., 0.); // black sky
         g_runnerColor = Cvec3f(245/255.0, 42/255.0, 76/255.0); // red runner
     }
@@ -317,411 +387,157 @@ static void changeColors() {
     }
 }
 
-// increases cube speed as tutorial progresses
-static void setCubeIncrDis() {
-    g_cubeIncrDis = g_cubeIncrDisMax - ( (g_cubeIncrDisMax - g_cubeIncrDisMin) / (g_simRateOriginal - g_simRateLowBound))*(g_simulationsPerCubeGen - g_simRateLowBound);
-}
+///////////////// END OF HELPER FUNCTIONS //////////////////////////////////////////////////
 
-// Jump functions:
-// raises camera and runner to jumpPeak
-static void jump() {
-    if (abs(g_jumpPeak - g_jumpHeight) > g_jumpAmount) {
-        g_jumpHeight = g_jumpHeight + g_jumpAmount;
-    }
-    else {
-        g_jumpPeakReached = true;
-    }
-}
-// lowers camera and runner after reaching jumpPeak
-static void descend() {
-    if (g_jumpHeight >= g_jumpAmount) {
-        g_jumpHeight = g_jumpHeight - g_jumpAmount;
-    }
-    else {
-        g_jumpHeight = 0.0;
-        g_jumpInProgress = false;
-        g_jumpPeakReached = false;
-    }
-}
-static void handleJump() {
-    if(g_jumpPeakReached) {
-        descend();
-        g_skyRbt = (g_originalSkyRbt * RigTForm(Cvec3(0, -.1, 0)) * inv(g_originalSkyRbt)) * g_skyRbt;
-        g_runnerRbt = (g_originalSkyRbt * RigTForm(Cvec3(0, -.1, 0)) * inv(g_originalSkyRbt)) * g_runnerRbt;
-    }
-    else {
-        jump();
-        g_skyRbt = (g_originalSkyRbt * RigTForm(Cvec3(0, .1, 0)) * inv(g_originalSkyRbt)) * g_skyRbt;
-        g_runnerRbt = (g_originalSkyRbt * RigTForm(Cvec3(0, .1, 0)) * inv(g_originalSkyRbt)) * g_runnerRbt;
-    }
-}
+// runs a single tick of the world
+static void runCubes() {
+    GameInput input;
+    input.left = g_leftDown;
+    input.right = g_rightDown;
+    input.jump = g_jumpDown;
+    g_jumpDown = false;
 
-// removes cubes from plane
-static void clearCubes() {
-    //g_numCubes = 0;
-    for (int layer = 0; layer < g_numLayers; layer++) {
-        g_cubeRbt[layer].clear();
-        g_cubeColors[layer].clear();
+    if (g_recorder) {
+        g_recorder->recordTick(input);
     }
-}
+    const unsigned events = g_rewind ? g_rewind->step(g_world, input) : g_world.step(input);
 
-// adds cubes to the plane
-static void addCubes() {
-    g_simCount = (g_simCount + 1) % (int)(g_secondsPerLevel * g_simulationsPerSecond * 3);
-    if (g_simCount % g_simulationsPerCubeGen == 0) {
-        float x = ((double) rand() / (RAND_MAX));
-        float z = ((double) rand() / (RAND_MAX));
-        float current_cubeZ = g_furthestCubeZ + g_zRange*z;
-        RigTForm current_cube = RigTForm(Cvec3(g_cubeFieldLeftSide + g_cubeFieldWidth*x,g_groundY + .5*g_cubeSideLength, current_cubeZ));
-        //int current_layer = (int) (current_cubeZ - g_furthestCubeZ) / ( ((int) g_zRange / g_numLayers) + 1);
-        int current_layer = (int) (x*g_numLayers);
-        g_cubeRbt[current_layer].push_back(current_cube);
-        
-        // SETTING COLOR
-        if (g_rgbCubesMode) {
-            // RED-GREEN-BLUE LEVELS MODE
-            float c = ((double) rand() / (RAND_MAX));
-            c = (.9 * c) + .1;
-            if(g_simCount < g_secondsPerLevel * g_simulationsPerSecond) {
-                g_cubeColors[current_layer].push_back(Cvec3f(c,0,0));
-            }
-            else if (g_simCount < 2*g_secondsPerLevel * g_simulationsPerSecond) {
-                g_cubeColors[current_layer].push_back(Cvec3f(0,c,0));
-            }
-            else {
-                g_cubeColors[current_layer].push_back(Cvec3f(0,0,c));
-            }
-        }
-        else if(g_deathMode) {
-            g_cubeColors[current_layer].push_back(Cvec3f(.1,.1,.1));
-        }
-        else {
-            // RANDOM COLORS MODE
-            float r = ((double) rand() / (RAND_MAX));
-            float g = ((double) rand() / (RAND_MAX));
-            float b = ((double) rand() / (RAND_MAX));
-            g_cubeColors[current_layer].push_back(Cvec3f(r,g,b));
-        }
-        
-        //g_numCubes++;
+    if (events & GAME_EVENT_NORMAL_MODE) {
+        cout << endl << "Normal Gameplay Mode" << endl;
     }
-}
-
-static void advanceCube(int layer, int i, Cvec3 current_position) {
-    // if the cube isn't already behind the camera, move it forward and spin it
-    if (current_position[2] < g_skyRbt.getTranslation()[2] + g_cubeSideLength) {
-        g_cubeRbt[layer][i].setTranslation((Cvec3(current_position[0], current_position[1], current_position[2] + g_cubeIncrDis)));
-        g_cubeRbt[layer][i] = (g_cubeRbt[layer][i] * RigTForm(Quat::makeYRotation(100)) * inv(g_cubeRbt[layer][i])) * g_cubeRbt[layer][i];
+    if (events & GAME_EVENT_SPEED_UP) {
+        printCubeGenRate();
     }
-    else {
-        g_cubeRbt[layer].erase(g_cubeRbt[layer].begin() + i);
-        g_cubeColors[layer].erase(g_cubeColors[layer].begin() + i);
+    if (events & GAME_EVENT_COLLISION) {
+        cout << endl << "COLLISION!" << endl;
+        cout << "Time: " << (float)(difftime(time(0), start_time) - pause_time) << " seconds" << endl;
+        cout << "Press the up arrow key to continue playing" << endl;
     }
 }
 
-static void moveCubesForward() {
-    for (int layer = 0; layer < g_numLayers; layer++) {
-        for (int i = 0; i < g_cubeRbt[layer].size(); i++) {
-            Cvec3 current_position = g_cubeRbt[layer][i].getTranslation();
-            g_cubeRbt[layer][i].setTranslation((Cvec3(current_position[0], current_position[1], current_position[2] + g_cubeIncrDis)));
-            g_cubeRbt[layer][i] = (g_cubeRbt[layer][i] * RigTForm(Quat::makeYRotation(100)) * inv(g_cubeRbt[layer][i])) * g_cubeRbt[layer][i];
+// simulation thread: runs every tick that is due while the game is on
+static void simulationLoop() {
+    const double tickSeconds = 1.0 / g_tickRate;
+    unique_lock<mutex> lock(g_worldMutex);
+    double nextTick = getMonotonicSeconds() + tickSeconds;
+    while (!g_quitting) {
+        if (!g_world.isGameOn() || g_gamePaused) {
+            // time spent stopped is not caught up on
+            g_simulationWake.wait(lock);
+            nextTick = getMonotonicSeconds() + tickSeconds;
+            continue;
         }
-    }
-}
-
-static void moveCubesBack() {
-    for (int layer = 0; layer < g_numLayers; layer++) {
-        for (int i = 0; i < g_cubeRbt[layer].size(); i++) {
-            Cvec3 current_position = g_cubeRbt[layer][i].getTranslation();
-            g_cubeRbt[layer][i].setTranslation((Cvec3(current_position[0], current_position[1], current_position[2] - g_cubeIncrDis)));
-            g_cubeRbt[layer][i] = (g_cubeRbt[layer][i] * RigTForm(Quat::makeYRotation(-100)) * inv(g_cubeRbt[layer][i])) * g_cubeRbt[layer][i];
+        const double now = getMonotonicSeconds();
+        if (now < nextTick) {
+            // the callbacks have the world while this thread sleeps
+            lock.unlock();
+            this_thread::sleep_for(chrono::duration<double>(nextTick - now));
+            lock.lock();
+            continue;
         }
+        nextTick = max(nextTick, now - g_maxFrameSeconds);
+        runCubes();
+        publishFrame(nextTick);
+        nextTick += tickSeconds;
     }
 }
 
-static void detectCollision(Cvec3 current_position) {
-    // if the runner point ever falls inside a cube, we have a collision
-    if (abs(g_skyRbt.getTranslation()[0] - current_position[0]) < (sqrt(2.0)/2.0)*g_cubeSideLength &&
-        abs(g_runnerRbt.getTranslation()[1] - current_position[1]) < .5*g_cubeSideLength &&
-        abs(g_runnerZ - current_position[2]) < .5*g_cubeSideLength ) {
-        
-        cout << endl << "COLLISION!" << endl;
-        cout << "Time: " << (float)(difftime(time(0), start_time) - pause_time) << " seconds" << endl;
-        cout << "Press the up arrow key to continue playing" << endl;
-        
-        // if we were in tutorial mode, restart the tutorial
-        if(g_tutorialMode) {
-            g_simCount = -1;
-            g_simulationsPerCubeGen = g_simRateOriginal;
-            setCubeIncrDis();
-        }
-        
-        //pause the game
-        g_gameOn = false;
+// idle callback: redraws for as long as ticks are coming
+static void redrawWhileAdvancing() {
+    if (!g_frames.newest().advancing) {
+        g_redrawing = false;
+        glutIdleFunc(NULL);
     }
+    glutPostRedisplay();
 }
 
-// moves camera and runner left while tilting screen clockwise
-static void moveLeft() {
-    if (g_skyRbt.getRotation()[3] < g_sinHalfMaxRotationAngle) {
-        // rotates the camera left
-        g_skyRbt = (g_skyRbt * RigTForm(Quat::makeZRotation(1)) * inv(g_skyRbt)) * g_skyRbt;
-        g_runnerRbt = (g_skyRbt * RigTForm(Quat::makeZRotation(1)) * inv(g_skyRbt)) * g_runnerRbt;
+// (re)starts ticking the world; called with g_worldMutex held
+static void startSimulation() {
+    publishChange();
+    g_simulationWake.notify_one();
+    if (!g_redrawing) {
+        g_redrawing = true;
+        glutIdleFunc(redrawWhileAdvancing);
     }
-    // translates the camera left
-    g_skyRbt = (g_originalSkyRbt * RigTForm(Cvec3(-g_xTranslationAmount, 0, 0)) * inv(g_originalSkyRbt)) * g_skyRbt;
-    g_runnerRbt = (g_originalSkyRbt * RigTForm(Cvec3(-g_xTranslationAmount, 0, 0)) * inv(g_originalSkyRbt)) * g_runnerRbt;
-    
-    // shifts rest of the screen right
-    g_cubeFieldLeftSide = g_cubeFieldLeftSide - g_xTranslationAmount;
-    g_groundX = g_groundX - g_xTranslationAmount;
-    g_light1X = g_light1X - g_xTranslationAmount;
-    g_light2X = g_light2X - g_xTranslationAmount;
 }
 
-// moves camera and runner right while tilting screen counter-clockwise
-static void moveRight() {
-    if (g_skyRbt.getRotation()[3] > -g_sinHalfMaxRotationAngle) {
-        // rotates the camera left
-        g_skyRbt = (g_skyRbt * RigTForm(Quat::makeZRotation(-1)) * inv(g_skyRbt)) * g_skyRbt;
-        g_runnerRbt = (g_skyRbt * RigTForm(Quat::makeZRotation(-1)) * inv(g_skyRbt)) * g_runnerRbt;
+// joins the simulation thread at exit, however the program exits
+static void stopSimulationThread() {
+    {
+        lock_guard<mutex> lock(g_worldMutex);
+        g_quitting = true;
+    }
+    g_simulationWake.notify_one();
+    if (g_simulationThread.joinable()) {
+        g_simulationThread.join();
     }
-    // translates the camera left
-    g_skyRbt = (g_originalSkyRbt * RigTForm(Cvec3(g_xTranslationAmount, 0, 0)) * inv(g_originalSkyRbt)) * g_skyRbt;
-    g_runnerRbt = (g_originalSkyRbt * RigTForm(Cvec3(g_xTranslationAmount, 0, 0)) * inv(g_originalSkyRbt)) * g_runnerRbt;
-    
-    // shifts rest of the screen left
-    g_cubeFieldLeftSide = g_cubeFieldLeftSide + g_xTranslationAmount;
-    g_groundX = g_groundX + g_xTranslationAmount;
-    g_light1X = g_light1X + g_xTranslationAmount;
-    g_light2X = g_light2X + g_xTranslationAmount;
 }
 
-// undo any tilting to the screen
-static void resetScreenRotation() {
-    if (abs(g_skyRbt.getRotation()[3]) <.01) {
-        // reset rotation
-        g_skyRbt.setRotation(Quat());
-        
-        g_runnerRbt.setRotation(Quat());
-        g_runnerRbt.setTranslation(Cvec3(g_skyRbt.getTranslation()[0], g_runnerRbt.getTranslation()[1], g_runnerRbt.getTranslation()[2]));
-    }
-    // if we're tilted left, tilt right
-    // if we're tilted right, tilt left
-    else if (g_skyRbt.getRotation()[3] < 0) {
-        g_skyRbt = (g_skyRbt * RigTForm(Quat::makeZRotation(3)) * inv(g_skyRbt)) * g_skyRbt;
-        
-        g_runnerRbt = (g_skyRbt * RigTForm(Quat::makeZRotation(3)) * inv(g_skyRbt)) * g_runnerRbt;
+static void printRunStats(const long long ticks, const long long collisions, const double seconds) {
+    cout << "Seed: " << g_world.getSeed() << endl;
+    cout << "Ticks: " << ticks << endl;
+    cout << "Simulated time: " << (double)ticks / g_world.getSimulationsPerSecond() << " seconds" << endl;
+    cout << "Collisions: " << collisions << endl;
+    cout << "Box test kernel: " << boxHitIsa() << endl;
+    if (g_planner) {
+        cout << "Planner searches cut short: " << g_planner->getTruncatedPlans() << endl;
     }
-    else if (g_skyRbt.getRotation()[3] > 0) {
-        g_skyRbt = (g_skyRbt * RigTForm(Quat::makeZRotation(-3)) * inv(g_skyRbt)) * g_skyRbt;
-        
-        g_runnerRbt = (g_skyRbt * RigTForm(Quat::makeZRotation(-3)) * inv(g_skyRbt)) * g_runnerRbt;
+    cout << "Wall time: " << seconds << " seconds";
+    if (seconds > 0) {
+        cout << " (" << ticks / seconds << " ticks/s)";
     }
+    cout << endl;
 }
 
-///////////////// END OF HELPER FUNCTIONS //////////////////////////////////////////////////
-
-static void runCubes(int dontCare) {
-    
-    addCubes();
-    
-    // when in tutorial mode, speed up every 5 seconds and increase cube-generation rate
-    // until you reach the normal gameplay speed, at which point switch to normal gameplay
-    if (g_simulationsPerCubeGen > g_simRateLowBound && g_simCount > 0 && g_simCount%(int)(g_secondsPerLevel * g_simulationsPerSecond) == 0 && g_tutorialMode) {
-        g_simulationsPerCubeGen--;
-        if(g_simulationsPerCubeGen == g_simRateLowBound) {
-            cout << endl << "Normal Gameplay Mode" << endl;
-            g_rgbCubesMode = true;
-            g_tutorialMode = false;
-            changeColors();
-        }
-        setCubeIncrDis();
-        cout << "Cubes generated per second: " << (int)(g_simulationsPerSecond/g_simulationsPerCubeGen) << endl;
-    }
-    
-    // move cubes and detect collisions
-    for (int layer = 0; layer < g_numLayers; layer++) {
-        for (int i = 0; i < g_cubeRbt[layer].size(); i++) {
-            
-            Cvec3 current_position = g_cubeRbt[layer][i].getTranslation();
-            
-            advanceCube(layer, i, current_position);
-            
-            detectCollision(current_position);
-        }
-    }
-    // AI plays game by choosing the least crowded paths and jumping when necessary
-    if (g_autonomous) {
-        
-        
-        int middle_layer = (int) (.5 * g_numLayers);
-        
-        if (g_cubeRbt[middle_layer].size() > g_cubeRbt[middle_layer - 1].size() || g_cubeRbt[middle_layer].size() > g_cubeRbt[middle_layer + 1].size()) {
-            if (g_cubeRbt[middle_layer - 1].size() < g_cubeRbt[middle_layer + 1].size()) {
-                g_leftDown = true;
-                g_rightDown = false;
-            }
-            else {
-                g_rightDown = true;
-                g_leftDown = false;
-            }
+// steps the simulation as fast as possible with no window, restarting after each collision
+static void runHeadless() {
+    long long collisions = 0;
+    const double begin = getMonotonicSeconds();
+    const GameInput input;
+    const long long endTick = g_world.getTicks() + g_headlessTicks;
+    while (g_world.getTicks() < endTick) {
+        unsigned events;
+        if (g_recorder) {
+            // every tick has to be written out, so step one at a time
+            g_recorder->recordTick(input);
+            events = g_world.step(input);
         }
         else {
-            g_leftDown = false;
-            g_rightDown = false;
+            // without input, jump straight to the next tick where something happens
+            events = g_world.fastForward(endTick - g_world.getTicks());
         }
-         
-        
-        
-        g_cyclesRequiredToClearCube = ceil((.5 * g_cubeSideLength) / g_xTranslationAmount);
-        g_minCyclesRequiredToJumpCube = ceil(g_cubeSideLength / g_jumpAmount);
-        g_maxCyclesRequiredToJumpCube = ceil(g_jumpPeak / g_jumpAmount);
-        
-        for (int layer = 0; layer < g_numLayers; layer++) {
-            for (int i = 0; i < g_cubeRbt[layer].size(); i++) {
-                Cvec3 current_position = g_cubeRbt[layer][i].getTranslation();
-         
-                /*
-                 g_rightDown = true;
-                 if(!g_jumpInProgress) {
-                     // if we're not jumping, and we'll hit a cube soon, swerve accordingly
-                     if (abs(g_skyRbt.getTranslation()[0] - current_position[0]) < (sqrt(2.0)/2.0)*g_cubeSideLength &&
-                         abs(g_runnerZ - current_position[2]) < .5*g_cubeSideLength  + g_cubeIncrDis*g_cyclesRequiredToClearCube ) {
-                         
-                         g_jumpInProgress = true;
-                         break;
-                     }
-                 }
-                 // if we're in the middle of a jump, but we're going to move left to avoid it
-                 // remember that momentum will make the runner land at the same point it would land if it hadn't jumped!
-                 else {
-                     if (abs(g_skyRbt.getTranslation()[0] - current_position[0]) < (sqrt(2.0)/2.0)*g_cubeSideLength &&
-                         abs(g_runnerZ - current_position[2]) < .5*g_cubeSideLength  + g_cubeIncrDis*g_cyclesRequiredToClearCube ) {
-                         
-                         g_rightDown = false;
-                         break;
-                     }
-                 }
-                 */
-                
-                
-                if(!g_jumpInProgress) {
-                    // if we're not jumping, and we'll hit a cube soon, swerve accordingly
-                    if (abs(g_skyRbt.getTranslation()[0] - current_position[0]) < (sqrt(2.0)/2.0)*g_cubeSideLength &&
-                        abs(g_runnerRbt.getTranslation()[1] - current_position[1]) < .5*g_cubeSideLength &&
-                        abs(g_runnerZ - current_position[2]) < .5*g_cubeSideLength  + g_cubeIncrDis*g_cyclesRequiredToClearCube &&
-                        abs(g_runnerZ - current_position[2]) > .5*g_cubeSideLength  + g_cubeIncrDis*(g_cyclesRequiredToClearCube - 1)) {
-                        
-                        // if the we will crash into the left side of the cube, swerve left
-                        if (g_skyRbt.getTranslation()[0] - current_position[0] > 0) {
-                            g_rightDown = true;
-                            break;
-                        }
-                        else {
-                            g_leftDown = true;
-                            break;
-                        }
-                    }
-                    // no time to swerve? jump!
-                    else if (abs(g_skyRbt.getTranslation()[0] - current_position[0]) < (sqrt(2.0)/2.0)*g_cubeSideLength &&
-                             abs(g_runnerRbt.getTranslation()[1] - current_position[1]) < .5*g_cubeSideLength &&
-                             abs(g_runnerZ - current_position[2]) - .5*g_cubeSideLength >= g_cubeIncrDis*g_minCyclesRequiredToJumpCube &&
-                             abs(g_runnerZ - current_position[2]) + .5*g_cubeSideLength <= g_cubeIncrDis*g_maxCyclesRequiredToJumpCube) {
-                        
-                        g_jumpInProgress = true;
-                        break;
-                    }
-                }
-                // if we're in the middle of a jump, but we're going to hit a cube, move to avoid it
-                // remember that momentum will make the runner land at the same point it would land if it hadn't jumped!
-                else {
-                    if (abs(g_skyRbt.getTranslation()[0] - current_position[0]) < (sqrt(2.0)/2.0)*g_cubeSideLength &&
-                        abs(g_runnerZ - current_position[2]) < .5*g_cubeSideLength  + g_cubeIncrDis*g_cyclesRequiredToClearCube ) {
-                        
-                        // if the we will crash into the left side of the cube, swerve left
-                        if (g_skyRbt.getTranslation()[0] - current_position[0] > 0) {
-                            g_rightDown = true;
-                            break;
-                        }
-                        else {
-                            g_leftDown = true;
-                            break;
-                        }
-                    }
-                }
-                
-            }
-        }
-        
-        // accounts for swerving into things immediately to your left/right
-        for (int layer = 0; layer < g_numLayers; layer++) {
-            for (int i = 0; i < g_cubeRbt[layer].size(); i++) {
-                Cvec3 current_position = g_cubeRbt[layer][i].getTranslation();
-                
-                if(g_rightDown) {
-                    if (current_position[0] - g_skyRbt.getTranslation()[0] < (sqrt(2.0)/2.0)*g_cubeSideLength + g_xTranslationAmount*g_minCyclesRequiredToJumpCube &&
-                        current_position[0] - g_skyRbt.getTranslation()[0] > 0 &&
-                        abs(g_runnerZ - current_position[2]) < .5*g_cubeSideLength  + g_cubeIncrDis*g_cyclesRequiredToClearCube ) {
-                        
-                        if (!g_jumpInProgress) {
-                           g_jumpInProgress = true;
-                        }
-                        else {
-                            g_rightDown = false;
-                            g_leftDown = false;
-                        }
-                    }
-                }
-                else if(g_leftDown) {
-                    if (current_position[0] - g_skyRbt.getTranslation()[0] > -((sqrt(2.0)/2.0)*g_cubeSideLength + g_xTranslationAmount*g_minCyclesRequiredToJumpCube) &&
-                        current_position[0] - g_skyRbt.getTranslation()[0] < 0 &&
-                        abs(g_runnerZ - current_position[2]) < .5*g_cubeSideLength  + g_cubeIncrDis*g_cyclesRequiredToClearCube ) {
-
-                        if (!g_jumpInProgress) {
-                            g_jumpInProgress = true;
-                        }
-                        else {
-                            g_rightDown = false;
-                            g_leftDown = false;
-                        }
-                    }
-                }
-                
-            }
+        if (events & GAME_EVENT_COLLISION) {
+            ++collisions;
+            issueCommand(GAME_COMMAND_RESTART);
         }
-        
-        
-        
-    }
-    
-    // continue tilting/moving camera as long as arrow keys are still held down
-    if(g_leftDown) {
-        moveLeft();
-    }
-    else if(g_rightDown) {
-        moveRight();
     }
-    // if arrow keys aren't being held, bring the screen rotation back to 0
-    else {
-        resetScreenRotation();
-    }
-    
-    if (g_autonomous) {
-        g_rightDown = false;
-        g_leftDown = false;
-    }
-    
-    // jump
-    if(g_jumpInProgress) {
-        handleJump();
+    const double seconds = getMonotonicSeconds() - begin;
+    printRunStats(g_headlessTicks, collisions, seconds);
+}
+
+// plays a --record log back as fast as possible
+static void runReplay() {
+    const double begin = getMonotonicSeconds();
+    const ReplayStats stats = replayInput(g_replayFile, g_world);
+    const double seconds = getMonotonicSeconds() - begin;
+    printRunStats(stats.ticks, stats.collisions, seconds);
+}
+
+// moves the game ticks ticks back (negative) or forward through its history
+// and leaves it paused there
+static void rewindBy(const long long ticks) {
+    if (!g_rewind) {
+        cout << "Rewind is not available while recording" << endl;
+        return;
     }
-    
-    // schedule this function to be called again
-    if (g_gameOn && !g_gamePaused) {
-        glutTimerFunc(1000/g_simulationsPerSecond, runCubes, 0);
+    g_rewind->seek(g_world, g_world.getTicks() + ticks);
+    if (g_world.isGameOn() && !g_gamePaused) {
+        g_gamePaused = true;
+        pause_begin = time(0);
     }
-    glutPostRedisplay(); // signal redisplaying
+    publishChange();
+    cout << "Tick " << g_world.getTicks() << " of " << g_rewind->firstTick() << "-" << g_rewind->lastTick()
+         << (g_world.isGameOn() ? ", press 'p' to resume" : "") << endl;
 }
 
 static void initCubes() {
@@ -740,8 +556,8 @@ static void initCubes() {
   cout << endl << "New Game Started" << endl;
     
   // Begin running the cubes
-  runCubes(0);
-  cout << "Cubes generated per second: " << (int)(g_simulationsPerSecond/g_simulationsPerCubeGen) << endl;
+  startSimulation();
+  printCubeGenRate();
 }
 
 // takes a projection matrix and send to the the shaders
@@ -778,7 +594,7 @@ static Matrix4 makeProjectionMatrix() {
 }
 
 
-static void drawStuff() {
+static void drawStuff(const WorldFrame& frame, const float alpha) {
   // short hand for current shader state
   const ShaderState& curSS = *g_shaderStates[g_activeShader];
 
@@ -787,17 +603,19 @@ static void drawStuff() {
   sendProjectionMatrix(curSS, projmat);
     
   // use the skyRbt as the eyeRbt
-  const RigTForm invSkyRbt = inv(g_skyRbt);
+  const PlayerPose pose = lerp(frame.prevPose, frame.pose, alpha);
+  const RigTForm invSkyRbt = inv(pose.skyRbt());
+  const float groundX = frame.prevGroundX + (frame.groundX - frame.prevGroundX) * alpha;
 
-  const Cvec3 eyeLight1 = Cvec3(invSkyRbt * Cvec4(g_light1X, g_light1[1], g_light1[2], 1)); // g_light1 position in sky coordinates
-  const Cvec3 eyeLight2 = Cvec3(invSkyRbt * Cvec4(g_light2X, g_light2[1], g_light2[2], 1)); // g_light2 position in sky coordinates
+  const Cvec3 eyeLight1 = Cvec3(invSkyRbt * Cvec4(groundX + g_light1[0], g_light1[1], g_light1[2], 1)); // g_light1 position in sky coordinates
+  const Cvec3 eyeLight2 = Cvec3(invSkyRbt * Cvec4(groundX + g_light2[0], g_light2[1], g_light2[2], 1)); // g_light2 position in sky coordinates
   safe_glUniform3f(curSS.h_uLight, eyeLight1[0], eyeLight1[1], eyeLight1[2]);
   safe_glUniform3f(curSS.h_uLight2, eyeLight2[0], eyeLight2[1], eyeLight2[2]);
 
   // draw ground
   // ===========
   //
-  const RigTForm groundRbt = RigTForm(Cvec3(g_groundX,0,0));
+  const RigTForm groundRbt = RigTForm(Cvec3(groundX,0,0));
   Matrix4 MVM = rigTFormToMatrix(invSkyRbt * groundRbt);
   Matrix4 NMVM = normalMatrix(MVM);
   sendModelViewNormalMatrix(curSS, MVM, NMVM);
@@ -807,7 +625,7 @@ static void drawStuff() {
   // draw runner
   // ===========
   //
-  MVM = rigTFormToMatrix(invSkyRbt * g_runnerRbt);
+  MVM = rigTFormToMatrix(invSkyRbt * pose.runnerRbt());
   NMVM = normalMatrix(MVM);
   sendModelViewNormalMatrix(curSS, MVM, NMVM);
     safe_glUniform3f(curSS.h_uColor, g_runnerColor[0], g_runnerColor[1], g_runnerColor[2]);
@@ -815,22 +633,33 @@ static void drawStuff() {
 
   // draw cubes
   // ==========
-  for (int layer = 0; layer < g_numLayers; layer++) {
-      for (int i = 0; i < g_cubeRbt[layer].size(); i++) {
-          MVM = rigTFormToMatrix(invSkyRbt * g_cubeRbt[layer][i]);
-          NMVM = normalMatrix(MVM);
-          sendModelViewNormalMatrix(curSS, MVM, NMVM);
-          safe_glUniform3f(curSS.h_uColor, g_cubeColors[layer][i][0], g_cubeColors[layer][i][1], g_cubeColors[layer][i][2]);
-          g_cube->draw(curSS);
-      }
+  const float scroll = frame.prevScroll + (frame.scroll - frame.prevScroll) * alpha;
+  const float spin = frame.prevSpin + (frame.spin - frame.prevSpin) * alpha;
+  for (size_t i = 0; i < frame.z.size(); i++) {
+      const RigTForm cubeRbt = RigTForm(Cvec3(frame.x[i], frame.y[i], frame.z[i] + scroll),
+                                        Quat::makeYRotation(spin - frame.spinPerTick * frame.spawnTick[i]));
+      const Cvec3f color = unpackColor(frame.color[i]);
+      MVM = rigTFormToMatrix(invSkyRbt * cubeRbt);
+      NMVM = normalMatrix(MVM);
+      sendModelViewNormalMatrix(curSS, MVM, NMVM);
+      safe_glUniform3f(curSS.h_uColor, color[0], color[1], color[2]);
+      g_cube->draw(curSS);
   }
 }
 
 static void display() {
+  // the newest tick, interpolated by the time since it was due
+  const WorldFrame& frame = g_frames.newest();
+  float alpha = 1;
+  if (frame.advancing) {
+    alpha = (float)min(1.0, max(0.0, (getMonotonicSeconds() - frame.tickTime) * g_tickRate));
+  }
+  changeColors(frame);
+
   glUseProgram(g_shaderStates[g_activeShader]->program);
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);                   // clear framebuffer color&depth
 
-  drawStuff();
+  drawStuff(frame, alpha);
   glutSwapBuffers();                                    // show the back buffer (where we rendered stuff)
 
   checkGlErrors();
@@ -838,9 +667,9 @@ static void display() {
 
 static void reshape(const int w, const int h) {
   g_windowWidth = w;
-  g_cubeFieldWidth = g_windowHeight / 128.0;
-  if (g_cubeFieldWidth < 1) {
-    g_cubeFieldWidth = 1;
+  {
+    lock_guard<mutex> lock(g_worldMutex);
+    issueCommand(GAME_COMMAND_SET_CUBE_FIELD_WIDTH, max(g_windowHeight / 128.0f, 1.0f));
   }
   g_windowHeight = h;
   glViewport(0, 0, w, h);
@@ -879,7 +708,8 @@ static void keyboardUp(const unsigned char key, const int x, const int y) {
 
 // new  special keyboard callback, for arrow keys
 static void specialKeyboardUp(const int key, const int x, const int y) {
-    if (!g_autonomous) {
+    lock_guard<mutex> lock(g_worldMutex);
+    if (!g_world.isAutonomous()) {
         switch (key) {
             case GLUT_KEY_RIGHT:
                 g_rightDown = false;
@@ -893,10 +723,12 @@ static void specialKeyboardUp(const int key, const int x, const int y) {
 }
 
 static void keyboard(const unsigned char key, const int x, const int y) {
+    // ESC closes window
+    if (key == 27) {
+        exit(0);
+    }
+    lock_guard<mutex> lock(g_worldMutex);
     switch (key) {
-        // ESC closes window
-        case 27:
-            exit(0);
         case 'h':
             cout << " ============== H E L P ==============\n\n"
             << "h\t\t\t\thelp menu\n"
@@ -914,6 +746,8 @@ static void keyboard(const unsigned char key, const int x, const int y) {
             << "t\t\t\t\tEnter tutorial mode\n"
             << "e\t\t\t\tEnter normal gameplay mode\n"
             << "d\t\t\t\tEnter death mode\n"
+            << ", .\t\t\t\tRewind / fast-forward one tick (paused or stopped)\n"
+            << "< >\t\t\t\tRewind / fast-forward one second (paused or stopped)\n"
             << endl;
             break;
         case 's':
@@ -925,50 +759,42 @@ static void keyboard(const unsigned char key, const int x, const int y) {
             break;
         // triggers jump
         case ' ':
-            if(!g_gamePaused && !g_autonomous) {
-                g_jumpInProgress = true;
+            if(!g_gamePaused && !g_world.isAutonomous()) {
+                g_jumpDown = true;
             }
             break;
         // increases the distance the cubes move each time, effectively making them faster (not in tutorial mode)
         case 'R':
         case 'r':
-            if (g_rgbCubesMode || g_deathMode) {
-                g_cubeIncrDis += .02;
+            if (issueCommand(GAME_COMMAND_INCREASE_SPEED)) {
                 cout << "Increasing speed!" << endl;
             }
             break;
         // decreases the distance the cubes move each time, effectively making them slower (not in tutorial mode)
         case 'V':
         case 'v':
-            if (g_rgbCubesMode || g_deathMode) {
-                if (g_cubeIncrDis > .02) {
-                    g_cubeIncrDis -= .02;
-                    cout << "Decreasing speed" << endl;
-                }
+            if (issueCommand(GAME_COMMAND_DECREASE_SPEED)) {
+                cout << "Decreasing speed" << endl;
             }
             break;
         // increases the rate at which the cubes are generated (not in tutorial mode)
         case 'Q':
         case 'q':
-            if (g_rgbCubesMode || g_deathMode) {
-                if (g_simulationsPerCubeGen > 1) {
-                    g_simulationsPerCubeGen -= 1;
-                }
-                if (g_simulationsPerCubeGen == 1) {
+            if (issueCommand(GAME_COMMAND_INCREASE_CUBE_GEN_RATE)) {
+                if (g_world.getSimulationsPerCubeGen() == 1) {
                     cout << "Reached Max Cube-Generation Rate" << endl;
                 }
                 else {
-                    cout << "Cubes generated per second: " << (int)(g_simulationsPerSecond/g_simulationsPerCubeGen) << endl;
+                    printCubeGenRate();
                 }
             }
             break;
         // decreases the rate at which the cubes are generated (not in tutorial mode)
         case 'Z':
         case 'z':
-            if (g_rgbCubesMode || g_deathMode) {
-                if (g_simulationsPerCubeGen <= g_simulationsPerSecond) {
-                    g_simulationsPerCubeGen += 1;
-                    cout << "Cubes generated per second: " << (int)(g_simulationsPerSecond/g_simulationsPerCubeGen) << endl;
+            if (g_world.isRgbCubesMode() || g_world.isDeathMode()) {
+                if (issueCommand(GAME_COMMAND_DECREASE_CUBE_GEN_RATE)) {
+                    printCubeGenRate();
                 }
                 else {
                     cout << "Reached Min Cube-Generation Rate" << endl;
@@ -978,92 +804,81 @@ static void keyboard(const unsigned char key, const int x, const int y) {
         // enters tutorial mode
         case 'T':
         case 't':
-            if (!g_gameOn) {
-                g_gameOn = true;
-                runCubes(0);
+            if (!g_world.isGameOn()) {
+                issueCommand(GAME_COMMAND_TUTORIAL_MODE);
+                startSimulation();
+            }
+            else {
+                issueCommand(GAME_COMMAND_TUTORIAL_MODE);
             }
-            g_simulationsPerCubeGen = g_simRateOriginal;
-            setCubeIncrDis();
-            g_tutorialMode = true;
-            g_rgbCubesMode = false;
-            g_deathMode = false;
-            clearCubes();
-            changeColors();
             start_time = time(0);
             pause_time = 0;
             cout << endl << "Tutorial Mode" << endl;
             cout << "Resetting clock" << endl;
-            cout << "Cubes generated per second: " << (int)(g_simulationsPerSecond/g_simulationsPerCubeGen) << endl;
+            printCubeGenRate();
             break;
         // enters normal gameplay mode
         case 'E':
         case 'e':
-            if (!g_gameOn) {
-                g_gameOn = true;
-                runCubes(0);
+            if (!g_world.isGameOn()) {
+                issueCommand(GAME_COMMAND_NORMAL_MODE);
+                startSimulation();
+            }
+            else {
+                issueCommand(GAME_COMMAND_NORMAL_MODE);
             }
-            g_simulationsPerCubeGen = g_simRateLowBound;
-            setCubeIncrDis();
-            g_tutorialMode = false;
-            g_rgbCubesMode = true;
-            g_deathMode = true;
-            clearCubes();
-            changeColors();
             start_time = time(0);
             pause_time = 0;
             cout << endl << "Normal Gameplay Mode" << endl;
             cout << "Resetting clock" << endl;
-            cout << "Cubes generated per second: " << (int)(g_simulationsPerSecond/g_simulationsPerCubeGen) << endl;
+            printCubeGenRate();
             break;
         // enters death mode
         case 'D':
         case 'd':
-            if (!g_gameOn) {
-                g_gameOn = true;
-                runCubes(0);
+            if (!g_world.isGameOn()) {
+                issueCommand(GAME_COMMAND_DEATH_MODE);
+                startSimulation();
+            }
+            else {
+                issueCommand(GAME_COMMAND_DEATH_MODE);
             }
-            g_simulationsPerCubeGen = 1;
-            g_cubeIncrDis = g_cubeIncrDisMax;
-            g_tutorialMode = false;
-            g_rgbCubesMode = false;
-            g_deathMode = true;
-            clearCubes();
-            changeColors();
             start_time = time(0);
             pause_time = 0;
             cout << endl << "Death Mode" << endl;
             cout << "Resetting clock" << endl;
-            cout << "Cubes generated per second: " << (int)(g_simulationsPerSecond/g_simulationsPerCubeGen) << endl;
+            printCubeGenRate();
             break;
         case 'P':
         case 'p':
-            if (g_gameOn) {
+            if (g_world.isGameOn()) {
                 g_gamePaused = !g_gamePaused;
                 if (!g_gamePaused) {
                     cout << "GAME RESUMED" <<endl;
                     pause_time = difftime(time(0), pause_begin);
-                    runCubes(0);
+                    startSimulation();
                 }
                 else {
                     cout << endl << "GAME PAUSED" << endl;
                     cout << "Press 'p' to resume" << endl <<endl;
                     pause_begin = time(0);
+                    publishChange();
                     
                     printCubeXValues();
                 }
             }
             break;
         case '1':
-            g_autonomous = !g_autonomous;
+            issueCommand(GAME_COMMAND_SET_AUTONOMOUS, !g_world.isAutonomous());
             break;
+        // steps through the game's history
         case ',':
-            if (!g_gameOn || g_gamePaused) {
-                moveCubesBack();
-            }
-            break;
         case '.':
-            if (!g_gameOn || g_gamePaused) {
-                moveCubesForward();
+        case '<':
+        case '>':
+            if (!g_world.isGameOn() || g_gamePaused) {
+                const long long ticks = (key == ',' || key == '.') ? 1 : g_tickRate;
+                rewindBy((key == ',' || key == '<') ? -ticks : ticks);
             }
             break;
   }
@@ -1072,31 +887,31 @@ static void keyboard(const unsigned char key, const int x, const int y) {
 
 // new  special keyboard callback, for arrow keys
 static void specialKeyboard(const int key, const int x, const int y) {
+        lock_guard<mutex> lock(g_worldMutex);
         switch (key) {
             // move right
             case GLUT_KEY_RIGHT:
-                if (!g_autonomous) {
+                if (!g_world.isAutonomous()) {
                     g_rightDown = true;
                     break;
                 }
             // move left
             case GLUT_KEY_LEFT:
-                if (!g_autonomous) {
+                if (!g_world.isAutonomous()) {
                     g_leftDown = true;
                     break;
                 }
             // resumes game after loss
             case GLUT_KEY_UP:
-                if(!g_gameOn) {
-                    if (g_tutorialMode) {
+                if(!g_world.isGameOn()) {
+                    if (g_world.isTutorialMode()) {
                         cout << endl << "Restarting Tutorial" << endl;
-                        cout << "Cubes generated per second: " << (int)(g_simulationsPerSecond/g_simulationsPerCubeGen) << endl;
+                        printCubeGenRate();
                     }
-                    clearCubes();
+                    issueCommand(GAME_COMMAND_RESTART);
                     start_time = time(0);
                     pause_time = 0;
-                    g_gameOn = true;
-                    runCubes(0);
+                    startSimulation();
                 }
                 break;
     }
@@ -1129,7 +944,6 @@ static void initGlutState(int argc, char * argv[]) {
 
 static void initGLState() {
   //glClearColor(128./255., 200./255., 255./255., 0.);
-  changeColors();
   glClearDepth(0.);
   glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
   glPixelStorei(GL_PACK_ALIGNMENT, 1);
@@ -1158,11 +972,104 @@ static void initGeometry() {
   initCubes();
 }
 
+// parses the command-line options handled before GLUT sees argv
+static void parseArgs(int argc, char * argv[]) {
+  for (int i = 1; i < argc; ++i) {
+    const string arg = argv[i];
+    if (arg == "--headless") {
+      g_headless = true;
+    }
+    else if (arg == "--ticks" && i + 1 < argc) {
+      g_headlessTicks = atoll(argv[++i]);
+    }
+    else if (arg == "--autonomous") {
+      g_world.setAutonomous(true);
+    }
+    else if (arg == "--planner") {
+      g_usePlanner = true;
+      g_world.setAutonomous(true);
+    }
+    else if (arg == "--planner-beam" && i + 1 < argc) {
+      g_plannerOptions.beamWidth = atoi(argv[++i]);
+    }
+    else if (arg == "--planner-horizon" && i + 1 < argc) {
+      g_plannerOptions.horizonSeconds = (float)atof(argv[++i]);
+    }
+    else if (arg == "--planner-threads" && i + 1 < argc) {
+      g_plannerOptions.threads = atoi(argv[++i]);
+    }
+    else if (arg == "--planner-budget" && i + 1 < argc) {
+      g_plannerOptions.timeBudget = atof(argv[++i]) / 1000;
+      if (!(g_plannerOptions.timeBudget >= 0))
+        throw runtime_error("Error: --planner-budget must be 0 (no limit) or more");
+    }
+    else if (arg == "--seed" && i + 1 < argc) {
+      g_world.setSeed(strtoull(argv[++i], NULL, 10));
+    }
+    else if (arg == "--record" && i + 1 < argc) {
+      g_recordFile = argv[++i];
+    }
+    else if (arg == "--replay" && i + 1 < argc) {
+      g_replayFile = argv[++i];
+    }
+    else if (arg == "--tick-rate" && i + 1 < argc) {
+      g_tickRate = atoi(argv[++i]);
+      if (g_tickRate < g_minSimulationsPerSecond || g_tickRate > g_maxSimulationsPerSecond)
+        throw runtime_error("Error: --tick-rate must be between 20 and 1000");
+      g_world.setSimulationsPerSecond(g_tickRate);
+    }
+    else if (arg == "--patterns" && i + 1 < argc) {
+      g_patterns.reset(new PatternLibrary(argv[++i]));
+      g_world.setPatternLibrary(g_patterns.get());
+    }
+    else if (arg == "--write-patterns" && i + 1 < argc) {
+      writeDefaultPatternLibrary(argv[++i]);
+      exit(0);
+    }
+  }
+  if (g_usePlanner) {
+    if (g_plannerOptions.threads <= 0) {
+      g_plannerOptions.threads = max(1, (int)thread::hardware_concurrency());
+    }
+    if (g_plannerOptions.beamWidth < 1 ||
+        !(g_plannerOptions.horizonSeconds > 0 && g_plannerOptions.horizonSeconds <= g_maxPlannerHorizon))
+      throw runtime_error("Error: --planner-beam must be positive, and --planner-horizon from 0 to 10");
+    g_planner.reset(new Planner(g_plannerOptions));
+    g_world.setPlanner(g_planner.get());
+  }
+  if (g_replayFile) {
+    return;
+  }
+  if (g_headless && g_headlessTicks <= 0) {
+    throw runtime_error("Error: --headless requires --ticks N with N > 0");
+  }
+}
+
 int main(int argc, char * argv[]) {
     
-  srand((unsigned int)time(0)); // seeds rand
+  g_world.setSeed((unsigned long long)time(0)); // --seed overrides this
     
   try {
+    parseArgs(argc, argv);
+    if (g_replayFile) {
+      runReplay();
+      return 0;
+    }
+    if (g_recordFile) {
+      g_recorder.reset(new InputRecorder(g_recordFile, g_world));
+    }
+    if (g_headless) {
+      runHeadless();
+      return 0;
+    }
+    if (!g_recorder) {
+      g_rewind.reset(new RewindBuffer(g_tickRate, g_rewindKeyframes));
+      g_rewind->restart(g_world);
+    }
+    g_spawner.reset(new SpawnPregenerator());
+    g_world.setSpawnPregenerator(g_spawner.get());
+
+    cout << "Seed: " << g_world.getSeed() << endl;
     initGlutState(argc,argv);
 
     // on Mac, we shouldn't use GLEW.
@@ -1184,6 +1091,8 @@ int main(int argc, char * argv[]) {
     initShaders();
     initGeometry();
 
+    g_simulationThread = thread(simulationLoop);
+    atexit(stopSimulationThread);
     glutMainLoop();
 
     return 0;
@@ -0,0 +1,200 @@
+#ifndef CUBESTORE_H
+#define CUBESTORE_H
+
+#include <algorithm>
+#include <vector>
+
+#include "cvec.h"
+
+// Packs a color with components in [0, 1] into RGBA8 (r in the low byte)
+inline unsigned packColor(const Cvec3f& c) {
+  unsigned r = (unsigned)(c[0] * 255 + .5f);
+  unsigned g = (unsigned)(c[1] * 255 + .5f);
+  unsigned b = (unsigned)(c[2] * 255 + .5f);
+  return r | (g << 8) | (b << 16) | (255u << 24);
+}
+
+inline Cvec3f unpackColor(const unsigned rgba) {
+  return Cvec3f((rgba & 0xff) / 255.f, ((rgba >> 8) & 0xff) / 255.f, ((rgba >> 16) & 0xff) / 255.f);
+}
+
+// Structure-of-arrays storage for the cubes of one layer. Each attribute lives
+// in its own contiguous array and all arrays are moved together, so the
+// per-tick loops only stream through the attributes they actually read.
+//
+// Cubes never move in the store. z holds the z the cube would have if the
+// world had scrolled 0, and spawnTick the tick it appeared on, so the owner
+// derives the current position and spin from its own scroll distance and tick.
+//
+// Cubes are kept sorted by decreasing z, so the cubes closest to the camera
+// are at the front and despawning pops a run off the front. The live cubes
+// are a window [head_, tail_) of arrays sized twice the capacity; when the
+// window reaches the end it slides back to the start, so the arrays stay
+// contiguous for the hot loops and nothing is allocated unless a lane ever
+// holds more than its capacity.
+//
+// The store also keeps a window [windowBegin_, windowEnd_) of the cubes within
+// some z range, which the autopilot uses for the cubes near the runner. Pushes
+// and despawns keep it pointing at the same cubes, and window() slides its
+// edges to new bounds, so following a range that moves a little each tick
+// only costs the cubes that enter or leave it. front() keeps a mark on the
+// first cube at or below one bound the same way.
+class CubeStore {
+  std::vector<float> x_, y_, z_; // cube centers, z at zero scroll
+  std::vector<int> spawnTick_;   // tick the cube was spawned on
+  std::vector<unsigned> color_;  // packed RGBA8
+  int head_, tail_;              // live cubes are [head_, tail_)
+  int windowBegin_, windowEnd_;  // cubes last found in window(), head_ <= begin <= end <= tail_
+  int front_;                    // cube last found by front(), head_ <= front_ <= tail_
+
+  void resizeArrays(const int n) {
+    x_.resize(n);
+    y_.resize(n);
+    z_.resize(n);
+    spawnTick_.resize(n);
+    color_.resize(n);
+  }
+
+  void move(const int to, const int from) {
+    x_[to] = x_[from];
+    y_[to] = y_[from];
+    z_[to] = z_[from];
+    spawnTick_[to] = spawnTick_[from];
+    color_[to] = color_[from];
+  }
+
+  // makes room for one more cube at tail_
+  void makeRoom() {
+    if (tail_ < (int)z_.size())
+      return;
+    if (head_ == 0) {
+      // more cubes than the capacity: grow rather than lose any
+      resizeArrays(2 * (int)z_.size());
+      return;
+    }
+    const int n = size();
+    for (int i = 0; i < n; ++i) {
+      move(i, head_ + i);
+    }
+    windowBegin_ -= head_;
+    windowEnd_ -= head_;
+    front_ -= head_;
+    head_ = 0;
+    tail_ = n;
+  }
+
+public:
+  CubeStore() : head_(0), tail_(0), windowBegin_(0), windowEnd_(0), front_(0) {
+    reserve(1);
+  }
+
+  // sizes the arrays so that up to capacity live cubes never allocate
+  void reserve(const int capacity) {
+    clear();
+    resizeArrays(2 * std::max(capacity, 1));
+  }
+
+  int size() const {
+    return tail_ - head_;
+  }
+
+  // attribute arrays of the live cubes, index 0 is the cube closest to the camera
+  const float* x() const { return &x_[head_]; }
+  const float* y() const { return &y_[head_]; }
+  const float* z() const { return &z_[head_]; }
+  const int* spawnTick() const { return &spawnTick_[head_]; }
+  const unsigned* color() const { return &color_[head_]; }
+
+  // inserts a cube, keeping the store sorted by decreasing z
+  void push(const float x, const float y, const float z, const int spawnTick, const unsigned color) {
+    makeRoom();
+    int i = tail_++;
+    for (; i > head_ && z_[i - 1] < z; --i) {
+      move(i, i - 1);
+    }
+    x_[i] = x;
+    y_[i] = y;
+    z_[i] = z;
+    spawnTick_[i] = spawnTick;
+    color_[i] = color;
+
+    if (i < windowBegin_) {
+      ++windowBegin_;
+      ++windowEnd_;
+    }
+    else if (i < windowEnd_) {
+      ++windowEnd_;
+    }
+    if (i < front_) {
+      ++front_;
+    }
+  }
+
+  void clear() {
+    head_ = tail_ = 0;
+    windowBegin_ = windowEnd_ = 0;
+    front_ = 0;
+  }
+
+  // shifts the stored z and spawn tick of every cube, used when the owner
+  // moves its scroll and tick origin to keep the numbers small
+  void rebase(const float dz, const int dtick) {
+    for (int i = head_; i < tail_; ++i) {
+      z_[i] += dz;
+    }
+    for (int i = head_; i < tail_; ++i) {
+      spawnTick_[i] += dtick;
+    }
+  }
+
+  // removes the cubes whose stored z is at least zLimit, all of them at the front
+  void despawnFrom(const float zLimit) {
+    while (head_ < tail_ && z_[head_] >= zLimit) {
+      ++head_;
+    }
+    if (head_ == tail_) {
+      clear();
+      return;
+    }
+    windowBegin_ = std::max(windowBegin_, head_);
+    windowEnd_ = std::max(windowEnd_, head_);
+    front_ = std::max(front_, head_);
+  }
+
+  // Moves the window to the cubes with z in [zMin, zMax] and returns the index
+  // of its first cube; windowSize() cubes from there are in it.
+  int window(const float zMin, const float zMax) {
+    while (windowBegin_ < tail_ && z_[windowBegin_] > zMax) {
+      ++windowBegin_;
+    }
+    while (windowBegin_ > head_ && z_[windowBegin_ - 1] <= zMax) {
+      --windowBegin_;
+    }
+    windowEnd_ = std::max(windowEnd_, windowBegin_);
+    while (windowEnd_ < tail_ && z_[windowEnd_] >= zMin) {
+      ++windowEnd_;
+    }
+    while (windowEnd_ > windowBegin_ && z_[windowEnd_ - 1] < zMin) {
+      --windowEnd_;
+    }
+    return windowBegin_ - head_;
+  }
+
+  int windowSize() const {
+    return windowEnd_ - windowBegin_;
+  }
+
+  // Moves the front mark to the first cube with z at most zMax and returns
+  // its index, size() if there is none.
+  int front(const float zMax) {
+    while (front_ < tail_ && z_[front_] > zMax) {
+      ++front_;
+    }
+    while (front_ > head_ && z_[front_ - 1] <= zMax) {
+      --front_;
+    }
+    return front_ - head_;
+  }
+};
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef GAMECLOCK_H
+#define GAMECLOCK_H
+
+// Monotonic high-resolution clock for pacing the simulation. Unlike time()
+// or GLUT's millisecond counter it never jumps with the wall clock and has
+// far better than millisecond resolution.
+
+#if defined(_WIN32)
+#   include <windows.h>
+#elif defined(__MAC__) || defined(__APPLE__)
+#   include <mach/mach_time.h>
+#else
+#   include <time.h>
+#endif
+
+// seconds since an arbitrary fixed point
+inline double getMonotonicSeconds() {
+#if defined(_WIN32)
+  static LARGE_INTEGER frequency;
+  if (frequency.QuadPart == 0) {
+    QueryPerformanceFrequency(&frequency);
+  }
+  LARGE_INTEGER now;
+  QueryPerformanceCounter(&now);
+  return (double)now.QuadPart / frequency.QuadPart;
+#elif defined(__MAC__) || defined(__APPLE__)
+  static mach_timebase_info_data_t timebase;
+  if (timebase.denom == 0) {
+    mach_timebase_info(&timebase);
+  }
+  return mach_absolute_time() * ((double)timebase.numer / timebase.denom) * 1e-9;
+#else
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec * 1e-9;
+#endif
+}
+
+#endif
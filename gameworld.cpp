@@ -0,0 +1,1089 @@
+#include <cstdlib>
+#include <cmath>
+#include <cfloat>
+#include <climits>
+#include <algorithm>
+
+#include "gameworld.h"
+#include "planner.h"
+#include "histogram.h"
+#include "gameclock.h"
+
+using namespace std;
+
+// events of the schedule_ wheel, handled in this order when due on the same tick
+enum {
+    SCHEDULED_COLOR_LEVEL, // next color level of the RGB cubes
+    SCHEDULED_SPAWN,       // a new cube
+    SCHEDULED_SPEED_UP     // tutorial speed-up
+};
+
+GameWorld::GameWorld()
+  : grid_((float)(sqrt(2.0)*g_cubeSideLength), g_cubeSideLength),
+    // rows a 32nd of a unit deep span 8 units, more than a cube travels from
+    // the far end of the field to despawning
+    occupancy_(g_xTranslationAmount, (float)(1.0/32)),
+    simulationsPerSecond_(g_simulationsPerSecond),
+    tickScale_(1),
+    spawner_(NULL),
+    planner_(NULL),
+    decisionTimes_(NULL),
+    patterns_(NULL)
+{
+    // at most one cube spawns per tick, and a cube lives at most as long as the
+    // slowest speed takes to carry it from the far end of the field past the camera
+    const int maxCubesPerLane = (int)ceil((g_cubeDespawnZ - g_furthestCubeZ) / g_cubeIncrDisFloor) + 1;
+    for (int layer = 0; layer < NUM_LAYERS; layer++) {
+        cubes_[layer].reserve(maxCubesPerLane);
+    }
+    reset(0);
+}
+
+void GameWorld::reset(const unsigned long long seed) {
+    player_.pose.x = 0;
+    player_.pose.tilt = 0;
+    player_.pose.height = 0;
+    scroll_ = 0;
+    spinTick_ = 0;
+    groundX_ = 0;
+    cubeFieldLeftSide_ = -2;
+    cubeFieldWidth_ = 4;
+    ticks_ = 0;
+    simulationsPerCubeGen_ = g_simRateOriginal;
+    secondsPerLevel_ = 5.0;
+    cubeIncrDis_ = g_cubeIncrDisMin;
+    gameOn_ = true;
+    tutorialMode_ = true;
+    rgbCubesMode_ = false;
+    deathMode_ = false;
+    autonomous_ = false;
+    player_.jumpInProgress = false;
+    player_.jumpPeakReached = false;
+    cubeEpoch_ = 0;
+    cubesSpawned_ = 0;
+    collisionTicks_ = CollisionTickQueue();
+    collisionKey_.epoch = -1;
+    setSeed(seed);
+    clearCubes();
+    restartScroll();
+    restartSchedule();
+    savePreviousTick();
+}
+
+void GameWorld::setSimulationsPerSecond(const int simulationsPerSecond) {
+    simulationsPerSecond_ = min(max(simulationsPerSecond, g_minSimulationsPerSecond), g_maxSimulationsPerSecond);
+    tickScale_ = (float)g_simulationsPerSecond / simulationsPerSecond_;
+    restartScroll();
+    restartSchedule();
+}
+
+// increases cube speed as tutorial progresses
+void GameWorld::setCubeIncrDis() {
+    cubeIncrDis_ = g_cubeIncrDisMax - ( (g_cubeIncrDisMax - g_cubeIncrDisMin) / (g_simRateOriginal - g_simRateLowBound))*(simulationsPerCubeGen_ - g_simRateLowBound);
+}
+
+// Jump functions:
+// raises camera and runner to jumpPeak
+void GameWorld::jump(PlayerState& player) const {
+    player.pose.height = min(player.pose.height + g_jumpAmount * tickScale_, g_jumpPeak);
+    if (player.pose.height == g_jumpPeak) {
+        player.jumpPeakReached = true;
+    }
+}
+// lowers camera and runner after reaching jumpPeak
+void GameWorld::descend(PlayerState& player) const {
+    player.pose.height = max(player.pose.height - g_jumpAmount * tickScale_, 0.f);
+    if (player.pose.height == 0) {
+        player.jumpInProgress = false;
+        player.jumpPeakReached = false;
+    }
+}
+void GameWorld::handleJump(PlayerState& player) const {
+    if(player.jumpPeakReached) {
+        descend(player);
+    }
+    else {
+        jump(player);
+    }
+}
+
+// removes cubes from plane
+void GameWorld::clearCubes() {
+    for (int layer = 0; layer < NUM_LAYERS; layer++) {
+        cubes_[layer].clear();
+    }
+    grid_.clear(g_cubeDespawnZ - scroll_);
+    occupancy_.clear(g_cubeDespawnZ - scroll_ + .5*g_cubeSideLength);
+    clearLaneTimes();
+    ++cubeEpoch_;
+
+    // the next chunk starts at the far end of the field
+    chunkZ_ = g_cubeDespawnZ - scroll_;
+    nextPattern_ = -1;
+}
+
+// remembers the state the renderer interpolates from
+void GameWorld::savePreviousTick() {
+    prevPose_ = player_.pose;
+    prevScroll_ = scroll_;
+    prevSpinTick_ = spinTick_;
+    prevGroundX_ = groundX_;
+}
+
+// Scrolling is kept as scrollBase_ + scrollIncr_ * scrollTicks_ rather than
+// summed a tick at a time, so the scroll of any later tick can be computed
+// directly (see fastForward) and matches stepping to it bit for bit.
+void GameWorld::restartScroll() {
+    scrollBase_ = scroll_;
+    scrollIncr_ = scrollPerTick();
+    scrollTicks_ = 0;
+}
+
+// scroll after n more ticks at the current speed
+float GameWorld::scrollAfter(const int n) const {
+    return scrollBase_ + scrollIncr_ * (float)(scrollTicks_ + n);
+}
+
+void GameWorld::advanceScroll(const int n) {
+    if (scrollIncr_ != scrollPerTick()) {
+        // the speed changed since the last tick
+        restartScroll();
+    }
+    scrollTicks_ += n;
+    scroll_ = scrollAfter(0);
+}
+
+// moves the scroll and spin origin back to 0 so the stored cube values stay small
+void GameWorld::rebaseScroll() {
+    for (int layer = 0; layer < NUM_LAYERS; layer++) {
+        cubes_[layer].rebase(scroll_, -spinTick_);
+    }
+    chunkZ_ += scroll_;
+    prevScroll_ -= scroll_;
+    prevSpinTick_ -= spinTick_;
+    scroll_ = 0;
+    spinTick_ = 0;
+    restartScroll();
+    ++cubeEpoch_;
+
+    // every stored z moved, so the grid cells have to be rebuilt
+    rebuildCubeIndexes(g_cubeDespawnZ);
+}
+
+// refills the grid and occupancy bitmap from the cube stores; zLimit is the
+// stored z past which cubes are despawned
+void GameWorld::rebuildCubeIndexes(const float zLimit) {
+    grid_.clear(zLimit);
+    occupancy_.clear(zLimit + .5*g_cubeSideLength);
+    for (int layer = 0; layer < NUM_LAYERS; layer++) {
+        const CubeStore& cubes = cubes_[layer];
+        for (int i = 0; i < cubes.size(); i++) {
+            grid_.insert(cubes.x()[i], cubes.y()[i], cubes.z()[i]);
+            occupancy_.insert(cubeFootprint(cubes.x()[i], cubes.y()[i], cubes.z()[i]));
+        }
+    }
+}
+
+// draws the next cube's position and color for the current mode
+SpawnRecord GameWorld::nextSpawn() {
+    // SETTING COLOR
+    int colors;
+    if (rgbCubesMode_) {
+        colors = SPAWN_COLORS_RED + colorLevel_;
+    }
+    else if(deathMode_) {
+        colors = SPAWN_COLORS_DEATH;
+    }
+    else {
+        colors = SPAWN_COLORS_RANDOM;
+    }
+    return spawner_ ? spawner_->take(rng_, colors) : drawSpawn(rng_, colors);
+}
+
+// adds a cube to the plane
+void GameWorld::addCube() {
+    const SpawnRecord spawn = nextSpawn();
+    const float current_cubeZ = spawn.z;
+    const int current_layer = (int) (spawn.x*NUM_LAYERS);
+
+    const float cube_x = cubeFieldLeftSide_ + cubeFieldWidth_*spawn.x;
+    const float cube_y = g_groundY + .5*g_cubeSideLength;
+    cubes_[current_layer].push(cube_x, cube_y, current_cubeZ - scroll_, spinTick_, spawn.color);
+    grid_.insert(cube_x, cube_y, current_cubeZ - scroll_);
+    occupancy_.insert(cubeFootprint(cube_x, cube_y, current_cubeZ - scroll_));
+    ++cubesSpawned_;
+    lastSpawn_[0] = cube_x;
+    lastSpawn_[1] = cube_y;
+    lastSpawn_[2] = current_cubeZ - scroll_;
+}
+
+// Splices in the chunks whose far edge has come within the far end of the
+// field. Chunks follow each other without gaps, each pattern drawn at random.
+void GameWorld::streamPatterns() {
+    if (nextPattern_ < 0) {
+        nextPattern_ = (int)(patternRng_.next() % (unsigned)patterns_->size());
+    }
+    for (;;) {
+        const float depth = patterns_->depth(nextPattern_);
+        const float farEdge = chunkZ_ - depth;
+        if (!(farEdge + scroll_ >= g_furthestCubeZ))
+            break;
+        // after the field is cleared the first chunk starts at its far end
+        chunkZ_ = min(chunkZ_, g_furthestCubeZ - scroll_ + depth);
+        splicePattern(nextPattern_);
+        chunkZ_ -= depth;
+        nextPattern_ = (int)(patternRng_.next() % (unsigned)patterns_->size());
+    }
+}
+
+// adds the cubes of a pattern at the next chunk, all in the color of one spawn
+void GameWorld::splicePattern(const int pattern) {
+    const SpawnRecord spawn = nextSpawn();
+    const int n = patterns_->numCubes(pattern);
+    const float cube_y = g_groundY + .5*g_cubeSideLength;
+    for (int i = 0; i < n; i++) {
+        const PatternCube cube = patterns_->cube(pattern, i);
+        const float cube_x = cubeFieldLeftSide_ + cubeFieldWidth_*cube.x;
+        const float cube_z = chunkZ_ - cube.dz;
+        const int layer = min((int)(cube.x*NUM_LAYERS), NUM_LAYERS - 1);
+        cubes_[layer].push(cube_x, cube_y, cube_z, spinTick_, spawn.color);
+        grid_.insert(cube_x, cube_y, cube_z);
+        occupancy_.insert(cubeFootprint(cube_x, cube_y, cube_z));
+        lastSpawn_[0] = cube_x;
+        lastSpawn_[1] = cube_y;
+        lastSpawn_[2] = cube_z;
+    }
+    cubesSpawned_ += n;
+}
+
+void GameWorld::moveCubesForward() {
+    scroll_ += scrollPerTick();
+    spinTick_++;
+    restartScroll();
+}
+
+void GameWorld::moveCubesBack() {
+    scroll_ -= scrollPerTick();
+    spinTick_--;
+    restartScroll();
+}
+
+// if the runner point ever falls inside a cube while the runner and cubes move
+// from their positions at the start of the tick (the runner box from) to those
+// at the end (to), we have a collision. Testing the whole motion rather than
+// its end points keeps fast cubes from passing through the runner. The
+// occupancy bitmap rules out most ticks with a few bit tests; otherwise only
+// the grid cells around the sweep are tested.
+bool GameWorld::detectCollision(const HitBox& from, const HitBox& to) const {
+    return occupancy_.mayOverlap(boxUnion(from, to)) && grid_.sweepHits(from, to);
+}
+
+// box around the runner that a cube center must be inside to collide, in
+// stored z for the given scroll instead of shifting every cube
+HitBox GameWorld::runnerHitBox(const PlayerPose& pose, const float scroll) const {
+    const float runnerX = pose.x;
+    const float runnerY = pose.height;
+    const float runnerZ = g_runnerZ - scroll;
+    const float halfWidth = (sqrt(2.0)/2.0)*g_cubeSideLength;
+    const float halfSide = .5*g_cubeSideLength;
+    return makeHitBox(runnerX, runnerY, runnerZ, halfWidth, halfSide, halfSide);
+}
+
+// runner positions (x and stored z) at which the runner box holds the cube
+// center, the cells the cube marks in the occupancy bitmap
+HitBox GameWorld::cubeFootprint(const float x, const float y, const float storedZ) const {
+    const float halfWidth = (sqrt(2.0)/2.0)*g_cubeSideLength;
+    const float halfSide = .5*g_cubeSideLength;
+    return makeHitBox(x, y, storedZ, halfWidth, halfSide, halfSide);
+}
+
+// moves camera and runner left while tilting screen clockwise, returns how
+// far the rest of the screen shifts
+float GameWorld::moveLeft(PlayerState& player) const {
+    const float xAmount = g_xTranslationAmount * tickScale_;
+    if (player.pose.tilt < g_maxRotationAngle) {
+        player.pose.tilt += g_tiltAmount * tickScale_;
+    }
+    player.pose.x -= xAmount;
+    return -xAmount;
+}
+
+// moves camera and runner right while tilting screen counter-clockwise
+float GameWorld::moveRight(PlayerState& player) const {
+    const float xAmount = g_xTranslationAmount * tickScale_;
+    if (player.pose.tilt > -g_maxRotationAngle) {
+        player.pose.tilt -= g_tiltAmount * tickScale_;
+    }
+    player.pose.x += xAmount;
+    return xAmount;
+}
+
+// undo any tilting to the screen
+void GameWorld::resetScreenRotation(PlayerState& player) const {
+    // within about half a step of level, so the steps back can't overshoot it forever
+    if (abs(player.pose.tilt) < g_levelTilt * tickScale_) {
+        player.pose.tilt = 0;
+    }
+    // if we're tilted left, tilt right
+    // if we're tilted right, tilt left
+    else if (player.pose.tilt < 0) {
+        player.pose.tilt += g_untiltAmount * tickScale_;
+    }
+    else {
+        player.pose.tilt -= g_untiltAmount * tickScale_;
+    }
+}
+
+float GameWorld::movePlayer(PlayerState& player, const GameInput& input) const {
+    if (input.jump) {
+        player.jumpInProgress = true;
+    }
+
+    // continue tilting/moving camera as long as arrow keys are still held down
+    float shift = 0;
+    if(input.left) {
+        shift = moveLeft(player);
+    }
+    else if(input.right) {
+        shift = moveRight(player);
+    }
+    // if arrow keys aren't being held, bring the screen rotation back to 0
+    else {
+        resetScreenRotation(player);
+    }
+
+    // jump
+    if(player.jumpInProgress) {
+        handleJump(player);
+    }
+    return shift;
+}
+
+// the earlier of two indices returned by firstBoxHit(), -1 if neither hit
+static int firstHit(const int a, const int b) {
+    if (a < 0)
+        return b;
+    if (b < 0)
+        return a;
+    return a < b ? a : b;
+}
+
+// how far in z from the runner the autopilot looks: past the farthest of the
+// boxes it scans, with half a cube to spare so rounding in them never reaches
+// beyond it
+float GameWorld::threatReach() const {
+    const float xAmount = g_xTranslationAmount * tickScale_;
+    const float jumpAmount = g_jumpAmount * tickScale_;
+    const int cyclesRequiredToClearCube = ceil((.5 * g_cubeSideLength) / xAmount);
+    const int maxCyclesRequiredToJumpCube = ceil(g_jumpPeak / jumpAmount);
+    const float halfSide = .5*g_cubeSideLength;
+    const float swerveFar = halfSide + scrollPerTick()*cyclesRequiredToClearCube;
+    const float jumpFar = scrollPerTick()*maxCyclesRequiredToJumpCube - halfSide;
+    return max(swerveFar, jumpFar) + halfSide;
+}
+
+// the autopilot's choice of lane: how soon a cube matters, in seconds, and
+// how much later a lane's next cube must come, per lane away and overall,
+// to be worth swerving for
+static const float g_laneHorizon = 1;
+static const float g_laneSwitchCost = .1;
+static const float g_laneSwitchMargin = .3;
+
+void GameWorld::clearLaneTimes() {
+    for (int lane = 0; lane < NUM_LAYERS; lane++) {
+        laneTimes_[lane] = FLT_MAX;
+    }
+}
+
+// Works out the time to collision of every lane from the nearest cube of each
+// layer that hasn't passed the runner. Each layer is sorted by z, and its
+// front mark follows that cube as the field scrolls and cubes spawn and
+// despawn, so a tick only reads NUM_LAYERS cubes however full the field is. A
+// cube counts for the lane its x is in now, relative to the field, which moves
+// with the runner, rather than the layer it spawned in, so the lanes stay
+// centered on the runner after it swerves.
+void GameWorld::trackLanes() {
+    clearLaneTimes();
+    const float speed = scrollPerTick() * simulationsPerSecond_;
+    if (!(speed > 0))
+        return;
+    const float runnerZ = g_runnerZ - scroll_;
+    const float halfSide = .5*g_cubeSideLength;
+    const float horizonZ = runnerZ - halfSide - g_laneHorizon*speed;
+    const float lanesPerX = NUM_LAYERS / cubeFieldWidth_;
+    for (int layer = 0; layer < NUM_LAYERS; layer++) {
+        CubeStore& cubes = cubes_[layer];
+        const int i = cubes.front(runnerZ + halfSide);
+        if (i == cubes.size() || cubes.z()[i] < horizonZ)
+            continue;
+        const int lane = min(max((int)floor((cubes.x()[i] - cubeFieldLeftSide_) * lanesPerX), 0), NUM_LAYERS - 1);
+        laneTimes_[lane] = min(laneTimes_[lane], max(0.f, runnerZ - halfSide - cubes.z()[i]) / speed);
+    }
+}
+
+// AI plays game by heading for the lanes whose cubes come latest and jumping when necessary
+void GameWorld::autopilot(GameInput& input) {
+    const float xAmount = g_xTranslationAmount * tickScale_;
+    const float jumpAmount = g_jumpAmount * tickScale_;
+    const float cubeIncrDis = scrollPerTick();
+    const int cyclesRequiredToClearCube = ceil((.5 * g_cubeSideLength) / xAmount);
+    const int minCyclesRequiredToJumpCube = ceil(g_cubeSideLength / jumpAmount);
+    const int maxCyclesRequiredToJumpCube = ceil(g_jumpPeak / jumpAmount);
+
+    int middle_layer = (int) (.5 * NUM_LAYERS);
+
+    // head for the lane whose next cube comes latest, less a cost for every lane crossed
+    int target = middle_layer;
+    float targetScore = min(laneTimes_[middle_layer], g_laneHorizon);
+    for (int lane = 0; lane < NUM_LAYERS; lane++) {
+        const float score = min(laneTimes_[lane], g_laneHorizon) - g_laneSwitchCost * abs(lane - middle_layer);
+        if (score > targetScore + g_laneSwitchMargin) {
+            target = lane;
+            targetScore = score;
+        }
+    }
+    input.left = target < middle_layer;
+    input.right = target > middle_layer;
+
+    // The scans below run the batched box kernel over each layer. Boxes are in
+    // stored z, so a cube at dz = runnerZ - z in front of the runner has stored
+    // z in (runnerZ - scroll_ - dz_max, runnerZ - scroll_ - dz_min).
+    const float runnerX = player_.pose.x;
+    const float runnerY = player_.pose.height;
+    const float runnerZ = g_runnerZ - scroll_;
+    const float halfWidth = (sqrt(2.0)/2.0)*g_cubeSideLength;
+    const float halfSide = .5*g_cubeSideLength;
+    const float swerveNear = halfSide + cubeIncrDis*(cyclesRequiredToClearCube - 1);
+    const float swerveFar = halfSide + cubeIncrDis*cyclesRequiredToClearCube;
+    const float jumpNear = halfSide + cubeIncrDis*minCyclesRequiredToJumpCube;
+    const float jumpFar = cubeIncrDis*maxCyclesRequiredToJumpCube - halfSide;
+
+    // cube ahead of the runner (or just behind it) when |dz| is in (near, far)
+    HitBox swerveAhead = makeHitBox(runnerX, runnerY, 0, halfWidth, halfSide, 0);
+    swerveAhead.minZ = runnerZ - swerveFar;
+    swerveAhead.maxZ = runnerZ - swerveNear;
+    HitBox swerveBehind = swerveAhead;
+    swerveBehind.minZ = runnerZ + swerveNear;
+    swerveBehind.maxZ = runnerZ + swerveFar;
+    HitBox jumpAhead = swerveAhead;
+    jumpAhead.minZ = runnerZ - jumpFar;
+    jumpAhead.maxZ = runnerZ - jumpNear;
+    HitBox jumpBehind = swerveAhead;
+    jumpBehind.minZ = runnerZ + jumpNear;
+    jumpBehind.maxZ = runnerZ + jumpFar;
+    // while jumping the runner's height is ignored
+    HitBox airborne = makeHitBox(runnerX, 0, runnerZ, halfWidth, FLT_MAX, swerveFar);
+
+    // every box scanned below lies within reach of the runner in x and the
+    // farther of the swerve and jump distances in z; when the bitmap shows
+    // that stretch empty there is nothing to react to
+    const float reach = halfWidth + xAmount*minCyclesRequiredToJumpCube;
+    const HitBox field = makeHitBox(runnerX, 0, runnerZ, reach, FLT_MAX, max(swerveFar, jumpFar));
+    const bool fieldClear = !occupancy_.mayOverlap(field);
+
+    // only the cubes within that z stretch can be hit, so each layer's scans
+    // run over the window its store keeps of them, whatever the size of the layer
+    const float reachZ = threatReach();
+    int windowFirst[NUM_LAYERS], windowSize[NUM_LAYERS];
+    for (int layer = 0; layer < NUM_LAYERS; layer++) {
+        windowFirst[layer] = cubes_[layer].window(runnerZ - reachZ, runnerZ + reachZ);
+        windowSize[layer] = cubes_[layer].windowSize();
+    }
+
+    for (int layer = 0; layer < NUM_LAYERS && !fieldClear; layer++) {
+        const CubeStore& cubes = cubes_[layer];
+        const int n = windowSize[layer];
+        const float* x = cubes.x() + windowFirst[layer];
+        const float* y = cubes.y() + windowFirst[layer];
+        const float* z = cubes.z() + windowFirst[layer];
+
+        // the first cube of the layer that needs a reaction decides it
+        int swerve = -1;
+        if(!player_.jumpInProgress) {
+            // if we're not jumping, and we'll hit a cube soon, swerve accordingly
+            swerve = firstHit(firstBoxHit(x, y, z, n, swerveAhead), firstBoxHit(x, y, z, n, swerveBehind));
+            // no time to swerve? jump!
+            const int jump = firstHit(firstBoxHit(x, y, z, n, jumpAhead), firstBoxHit(x, y, z, n, jumpBehind));
+            if (jump >= 0 && (swerve < 0 || jump < swerve)) {
+                player_.jumpInProgress = true;
+                continue;
+            }
+        }
+        // if we're in the middle of a jump, but we're going to hit a cube, move to avoid it
+        // remember that momentum will make the runner land at the same point it would land if it hadn't jumped!
+        else {
+            swerve = firstBoxHit(x, y, z, n, airborne);
+        }
+
+        if (swerve >= 0) {
+            // if the we will crash into the left side of the cube, swerve left
+            if (runnerX - x[swerve] > 0) {
+                input.right = true;
+            }
+            else {
+                input.left = true;
+            }
+        }
+    }
+
+    // accounts for swerving into things immediately to your left/right: the
+    // first such cube makes us jump, and a second one (or one while already
+    // jumping) stops the swerve
+    if ((input.right || input.left) && !fieldClear) {
+        HitBox side = makeHitBox(runnerX, 0, runnerZ, 0, FLT_MAX, swerveFar);
+        if (input.right) {
+            side.maxX = runnerX + reach;
+        }
+        else {
+            side.minX = runnerX - reach;
+        }
+
+        int hits = 0;
+        for (int layer = 0; layer < NUM_LAYERS && hits < 2; layer++) {
+            const CubeStore& cubes = cubes_[layer];
+            const int first = windowFirst[layer];
+            hits += countBoxHits(cubes.x() + first, cubes.y() + first, cubes.z() + first, windowSize[layer], side);
+        }
+        if (hits > 0 && !player_.jumpInProgress) {
+            player_.jumpInProgress = true;
+            --hits;
+        }
+        if (hits > 0) {
+            input.right = false;
+            input.left = false;
+        }
+    }
+}
+
+int GameWorld::ticksPerLevel() const {
+    return (int)(secondsPerLevel_ * simulationsPerSecond_);
+}
+
+// Starts the spawn, color-level and tutorial timers over: the next tick
+// spawns a cube, and the first level change comes one level from now.
+void GameWorld::restartSchedule() {
+    schedule_.clear(ticks_);
+    colorLevel_ = 0;
+    nextSpawnTime_ = (ticks_ + 1) * g_simulationsPerSecond;
+    schedule_.schedule(ticks_ + 1, SCHEDULED_SPAWN);
+    schedule_.schedule(ticks_ + ticksPerLevel(), SCHEDULED_COLOR_LEVEL);
+    if (tutorialMode_) {
+        schedule_.schedule(ticks_ + ticksPerLevel(), SCHEDULED_SPEED_UP);
+    }
+}
+
+// handles the schedule_ events due on the current tick, each of which
+// schedules its own next occurrence
+unsigned GameWorld::runScheduledEvents() {
+    unsigned events = 0;
+    dueEvents_.clear();
+    schedule_.advance(ticks_, dueEvents_);
+    if (dueEvents_.empty())
+        return events;
+    unsigned due = 0;
+    for (size_t i = 0; i < dueEvents_.size(); ++i) {
+        due |= 1u << dueEvents_[i];
+    }
+
+    if (due & (1u << SCHEDULED_COLOR_LEVEL)) {
+        colorLevel_ = (colorLevel_ + 1) % 3;
+        schedule_.schedule(ticks_ + ticksPerLevel(), SCHEDULED_COLOR_LEVEL);
+    }
+    if (due & (1u << SCHEDULED_SPAWN)) {
+        // Spawns are timed in default ticks, which at a low tick rate can be
+        // shorter than a tick, so every spawn due by now happens now. With a
+        // pattern library the spawn rate only sets the difficulty through the
+        // speed; the chunks come in from step().
+        const long long now = ticks_ * g_simulationsPerSecond;
+        while (nextSpawnTime_ <= now) {
+            if (!patterns_) {
+                addCube();
+            }
+            nextSpawnTime_ += (long long)simulationsPerCubeGen_ * simulationsPerSecond_;
+        }
+        schedule_.schedule((nextSpawnTime_ + g_simulationsPerSecond - 1) / g_simulationsPerSecond, SCHEDULED_SPAWN);
+    }
+    // when in tutorial mode, speed up every 5 seconds and increase cube-generation rate
+    // until you reach the normal gameplay speed, at which point switch to normal gameplay
+    if ((due & (1u << SCHEDULED_SPEED_UP)) && tutorialMode_ && simulationsPerCubeGen_ > g_simRateLowBound) {
+        simulationsPerCubeGen_--;
+        if(simulationsPerCubeGen_ == g_simRateLowBound) {
+            rgbCubesMode_ = true;
+            tutorialMode_ = false;
+            events |= GAME_EVENT_NORMAL_MODE;
+        }
+        else {
+            schedule_.schedule(ticks_ + ticksPerLevel(), SCHEDULED_SPEED_UP);
+        }
+        setCubeIncrDis();
+        events |= GAME_EVENT_SPEED_UP;
+    }
+    return events;
+}
+
+unsigned GameWorld::step(const GameInput& input) {
+    unsigned events = 0;
+    GameInput current_input = input;
+
+    if (current_input.jump) {
+        player_.jumpInProgress = true;
+    }
+
+    savePreviousTick();
+    ++ticks_;
+    events |= runScheduledEvents();
+    if (patterns_) {
+        streamPatterns();
+    }
+
+    // drop cubes that are already behind the camera
+    const float despawnZ = g_cubeDespawnZ - scroll_;
+    for (int layer = 0; layer < NUM_LAYERS; layer++) {
+        cubes_[layer].despawnFrom(despawnZ);
+    }
+    grid_.despawnFrom(despawnZ);
+    occupancy_.despawnFrom(despawnZ + .5*g_cubeSideLength);
+
+    const HitBox runnerFrom = runnerHitBox(player_.pose, scroll_);
+
+    // move every cube forward and spin it
+    advanceScroll(1);
+    spinTick_++;
+
+    const bool timed = autonomous_ && decisionTimes_;
+    const double decisionBegin = timed ? getMonotonicSeconds() : 0;
+    if (autonomous_ && planner_) {
+        current_input = planner_->plan(*this, prevScroll_);
+        if (current_input.jump) {
+            player_.jumpInProgress = true;
+        }
+    }
+    else if (autonomous_) {
+        trackLanes();
+        autopilot(current_input);
+    }
+    if (timed) {
+        decisionTimes_->add(getMonotonicSeconds() - decisionBegin);
+    }
+
+    // the rest of the screen shifts the other way
+    const float shift = movePlayer(player_, current_input);
+    cubeFieldLeftSide_ = cubeFieldLeftSide_ + shift;
+    groundX_ = groundX_ + shift;
+
+    if (detectCollision(runnerFrom, runnerHitBox(player_.pose, scroll_))) {
+        // if we were in tutorial mode, restart the tutorial
+        if(tutorialMode_) {
+            simulationsPerCubeGen_ = g_simRateOriginal;
+            setCubeIncrDis();
+            restartSchedule();
+        }
+
+        // stop the game
+        gameOn_ = false;
+        events |= GAME_EVENT_COLLISION;
+    }
+
+    // stored z values are rebased only once the tick's motion has been tested
+    if (scroll_ > g_scrollRebaseDistance) {
+        rebaseScroll();
+    }
+
+    return events;
+}
+
+void GameWorld::startTutorialMode() {
+    gameOn_ = true;
+    simulationsPerCubeGen_ = g_simRateOriginal;
+    setCubeIncrDis();
+    tutorialMode_ = true;
+    rgbCubesMode_ = false;
+    deathMode_ = false;
+    clearCubes();
+    restartSchedule();
+}
+
+void GameWorld::startNormalMode() {
+    gameOn_ = true;
+    simulationsPerCubeGen_ = g_simRateLowBound;
+    setCubeIncrDis();
+    tutorialMode_ = false;
+    rgbCubesMode_ = true;
+    deathMode_ = true;
+    clearCubes();
+    restartSchedule();
+}
+
+void GameWorld::startDeathMode() {
+    gameOn_ = true;
+    simulationsPerCubeGen_ = 1;
+    cubeIncrDis_ = g_cubeIncrDisMax;
+    tutorialMode_ = false;
+    rgbCubesMode_ = false;
+    deathMode_ = true;
+    clearCubes();
+    restartSchedule();
+}
+
+void GameWorld::restart() {
+    clearCubes();
+    gameOn_ = true;
+}
+
+bool GameWorld::applyCommand(const GameCommand command, const float value) {
+    const bool applied = dispatchCommand(command, value);
+    // commands take effect at once, so frames are not interpolated across them
+    savePreviousTick();
+    return applied;
+}
+
+void GameWorld::saveSnapshot(WorldSnapshot& snapshot) const {
+    WorldSnapshot::Scalars& s = snapshot.scalars;
+    s.pose = player_.pose;
+    s.prevPose = prevPose_;
+    s.scroll = scroll_;
+    s.prevScroll = prevScroll_;
+    s.scrollBase = scrollBase_;
+    s.scrollIncr = scrollIncr_;
+    s.spinTick = spinTick_;
+    s.prevSpinTick = prevSpinTick_;
+    s.scrollTicks = scrollTicks_;
+    s.groundX = groundX_;
+    s.prevGroundX = prevGroundX_;
+    s.cubeFieldLeftSide = cubeFieldLeftSide_;
+    s.cubeFieldWidth = cubeFieldWidth_;
+    s.ticks = ticks_;
+    s.nextSpawnTime = nextSpawnTime_;
+    s.colorLevel = colorLevel_;
+    s.simulationsPerCubeGen = simulationsPerCubeGen_;
+    s.secondsPerLevel = secondsPerLevel_;
+    s.cubeIncrDis = cubeIncrDis_;
+    s.gameOn = gameOn_;
+    s.tutorialMode = tutorialMode_;
+    s.rgbCubesMode = rgbCubesMode_;
+    s.deathMode = deathMode_;
+    s.autonomous = autonomous_;
+    s.jumpInProgress = player_.jumpInProgress;
+    s.jumpPeakReached = player_.jumpPeakReached;
+    s.seed = seed_;
+    s.rng = rng_;
+    s.cubesSpawned = cubesSpawned_;
+    for (int i = 0; i < 3; ++i) {
+        s.lastSpawn[i] = lastSpawn_[i];
+    }
+    s.chunkZ = chunkZ_;
+    s.nextPattern = nextPattern_;
+    s.patternRng = patternRng_;
+
+    snapshot.layerSizes.resize(NUM_LAYERS);
+    snapshot.x.clear();
+    snapshot.y.clear();
+    snapshot.z.clear();
+    snapshot.spawnTick.clear();
+    snapshot.color.clear();
+    for (int layer = 0; layer < NUM_LAYERS; layer++) {
+        const CubeStore& cubes = cubes_[layer];
+        const int n = cubes.size();
+        snapshot.layerSizes[layer] = n;
+        snapshot.x.insert(snapshot.x.end(), cubes.x(), cubes.x() + n);
+        snapshot.y.insert(snapshot.y.end(), cubes.y(), cubes.y() + n);
+        snapshot.z.insert(snapshot.z.end(), cubes.z(), cubes.z() + n);
+        snapshot.spawnTick.insert(snapshot.spawnTick.end(), cubes.spawnTick(), cubes.spawnTick() + n);
+        snapshot.color.insert(snapshot.color.end(), cubes.color(), cubes.color() + n);
+    }
+
+    snapshot.scheduled.clear();
+    schedule_.pending(snapshot.scheduled);
+}
+
+// the grid, bitmap and fast-forward queue are not saved but rebuilt from the
+// cubes, since they only ever speed up questions about them
+void GameWorld::restoreSnapshot(const WorldSnapshot& snapshot) {
+    const WorldSnapshot::Scalars& s = snapshot.scalars;
+    player_.pose = s.pose;
+    prevPose_ = s.prevPose;
+    scroll_ = s.scroll;
+    prevScroll_ = s.prevScroll;
+    scrollBase_ = s.scrollBase;
+    scrollIncr_ = s.scrollIncr;
+    spinTick_ = s.spinTick;
+    prevSpinTick_ = s.prevSpinTick;
+    scrollTicks_ = s.scrollTicks;
+    groundX_ = s.groundX;
+    prevGroundX_ = s.prevGroundX;
+    cubeFieldLeftSide_ = s.cubeFieldLeftSide;
+    cubeFieldWidth_ = s.cubeFieldWidth;
+    ticks_ = s.ticks;
+    nextSpawnTime_ = s.nextSpawnTime;
+    colorLevel_ = s.colorLevel;
+    simulationsPerCubeGen_ = s.simulationsPerCubeGen;
+    secondsPerLevel_ = s.secondsPerLevel;
+    cubeIncrDis_ = s.cubeIncrDis;
+    gameOn_ = s.gameOn;
+    tutorialMode_ = s.tutorialMode;
+    rgbCubesMode_ = s.rgbCubesMode;
+    deathMode_ = s.deathMode;
+    autonomous_ = s.autonomous;
+    player_.jumpInProgress = s.jumpInProgress;
+    player_.jumpPeakReached = s.jumpPeakReached;
+    seed_ = s.seed;
+    rng_ = s.rng;
+    cubesSpawned_ = s.cubesSpawned;
+    for (int i = 0; i < 3; ++i) {
+        lastSpawn_[i] = s.lastSpawn[i];
+    }
+    chunkZ_ = s.chunkZ;
+    nextPattern_ = s.nextPattern;
+    patternRng_ = s.patternRng;
+
+    // the cubes of a layer were saved closest first, so pushing them in order
+    // keeps them in the same order
+    int first = 0;
+    for (int layer = 0; layer < NUM_LAYERS; layer++) {
+        CubeStore& cubes = cubes_[layer];
+        cubes.clear();
+        const int end = first + snapshot.layerSizes[layer];
+        for (int i = first; i < end; i++) {
+            cubes.push(snapshot.x[i], snapshot.y[i], snapshot.z[i], snapshot.spawnTick[i], snapshot.color[i]);
+        }
+        first = end;
+    }
+    rebuildCubeIndexes(g_cubeDespawnZ - scroll_);
+    clearLaneTimes();
+    ++cubeEpoch_;
+
+    schedule_.clear(ticks_);
+    for (size_t i = 0; i < snapshot.scheduled.size(); ++i) {
+        schedule_.schedule(snapshot.scheduled[i].tick, snapshot.scheduled[i].event);
+    }
+}
+
+bool GameWorld::dispatchCommand(const GameCommand command, const float value) {
+    switch (command) {
+        case GAME_COMMAND_TUTORIAL_MODE:
+            startTutorialMode();
+            return true;
+        case GAME_COMMAND_NORMAL_MODE:
+            startNormalMode();
+            return true;
+        case GAME_COMMAND_DEATH_MODE:
+            startDeathMode();
+            return true;
+        case GAME_COMMAND_RESTART:
+            restart();
+            return true;
+        case GAME_COMMAND_INCREASE_SPEED:
+            return increaseSpeed();
+        case GAME_COMMAND_DECREASE_SPEED:
+            return decreaseSpeed();
+        case GAME_COMMAND_INCREASE_CUBE_GEN_RATE:
+            return increaseCubeGenRate();
+        case GAME_COMMAND_DECREASE_CUBE_GEN_RATE:
+            return decreaseCubeGenRate();
+        case GAME_COMMAND_MOVE_CUBES_FORWARD:
+            moveCubesForward();
+            return true;
+        case GAME_COMMAND_MOVE_CUBES_BACK:
+            moveCubesBack();
+            return true;
+        case GAME_COMMAND_SET_AUTONOMOUS:
+            setAutonomous(value != 0);
+            return true;
+        case GAME_COMMAND_SET_CUBE_FIELD_WIDTH:
+            setCubeFieldWidth(value);
+            return true;
+        default:
+            return false;
+    }
+}
+
+// increases the distance the cubes move each time, effectively making them faster (not in tutorial mode)
+bool GameWorld::increaseSpeed() {
+    if (rgbCubesMode_ || deathMode_) {
+        cubeIncrDis_ += .02;
+        return true;
+    }
+    return false;
+}
+
+// decreases the distance the cubes move each time, effectively making them slower (not in tutorial mode)
+bool GameWorld::decreaseSpeed() {
+    if ((rgbCubesMode_ || deathMode_) && cubeIncrDis_ > g_cubeIncrDisFloor) {
+        cubeIncrDis_ -= .02;
+        return true;
+    }
+    return false;
+}
+
+// increases the rate at which the cubes are generated (not in tutorial mode)
+bool GameWorld::increaseCubeGenRate() {
+    if (rgbCubesMode_ || deathMode_) {
+        if (simulationsPerCubeGen_ > 1) {
+            simulationsPerCubeGen_ -= 1;
+        }
+        return true;
+    }
+    return false;
+}
+
+// decreases the rate at which the cubes are generated (not in tutorial mode)
+bool GameWorld::decreaseCubeGenRate() {
+    if ((rgbCubesMode_ || deathMode_) && simulationsPerCubeGen_ <= g_simulationsPerSecond) {
+        simulationsPerCubeGen_ += 1;
+        return true;
+    }
+    return false;
+}
+
+// Fast-forward:
+//
+// With no input and the runner at rest, a tick changes nothing but the tick
+// and level counters, the scroll and spin, and the cubes that spawn, despawn
+// or hit the runner. All of those happen on ticks that can be computed ahead:
+// spawns and level changes are in the schedule_ wheel, the scroll rebase and
+// pattern chunks follow from the scroll formula, and for each cube in the runner's path the first tick its
+// center enters the runner's box. Those collision ticks sit in a priority
+// queue that is extended as cubes spawn and rebuilt whenever the scroll
+// formula, the runner or the cube set change in any other way. fastForward
+// jumps straight to the tick before the earliest of them and runs that tick
+// with step(). Despawns only free storage and are applied by that step().
+
+static const long long NEVER = LLONG_MAX;
+
+// resetScreenRotation() leaves a level runner alone
+bool GameWorld::isRunnerAtRest() const {
+    return !autonomous_ && !player_.jumpInProgress && cubeIncrDis_ > 0 && player_.pose.tilt == 0;
+}
+
+// ticks until the tick that ends with a scroll rebase
+long long GameWorld::ticksToRebase() const {
+    int k = max(1, (int)ceil((g_scrollRebaseDistance - scrollBase_) / scrollIncr_) - scrollTicks_);
+    while (k > 1 && scrollAfter(k - 1) > g_scrollRebaseDistance) {
+        --k;
+    }
+    while (!(scrollAfter(k) > g_scrollRebaseDistance)) {
+        ++k;
+    }
+    return k;
+}
+
+// ticks until the tick that splices in the next pattern chunk, which
+// streamPatterns() does before the tick moves the scroll
+long long GameWorld::ticksToNextChunk() const {
+    if (!patterns_)
+        return NEVER;
+    if (nextPattern_ < 0)
+        return 1;
+    // tested exactly as streamPatterns() does, the estimate is only a start
+    const float farEdge = chunkZ_ - patterns_->depth(nextPattern_);
+    int j = max(0, (int)ceil((g_furthestCubeZ - farEdge - scrollBase_) / scrollIncr_) - scrollTicks_);
+    while (j > 0 && farEdge + scrollAfter(j - 1) >= g_furthestCubeZ) {
+        --j;
+    }
+    while (!(farEdge + scrollAfter(j) >= g_furthestCubeZ)) {
+        ++j;
+    }
+    return j + 1;
+}
+
+// The tick on which detectCollision() will find the cube at (x, y, storedZ)
+// if the runner stays at rest, or NEVER. Tick ticks_ + j + 1 sweeps the
+// runner box from scrollAfter(j) to scrollAfter(j + 1), only along z, which
+// sweptBoxContains() tests against the swept bounds. The box slides towards
+// -z as the scroll grows, so the end box is past the cube from some j on, and
+// the cube collides on that first j unless the start box is already past it.
+long long GameWorld::collisionTick(const float x, const float y, const float storedZ) const {
+    const HitBox now = runnerHitBox(player_.pose, scrollAfter(0));
+    if (!(x > now.minX && x < now.maxX && y > now.minY && y < now.maxY))
+        return NEVER;
+
+    const float halfSide = .5*g_cubeSideLength;
+    int j = max(0, (int)ceil((g_runnerZ - halfSide - storedZ - scrollBase_) / scrollIncr_) - scrollTicks_ - 1);
+    // the estimate is off by at most a tick or two, walk it to the exact tick
+    while (j > 0 && storedZ > runnerHitBox(player_.pose, scrollAfter(j)).minZ) {
+        --j;
+    }
+    while (!(storedZ > runnerHitBox(player_.pose, scrollAfter(j + 1)).minZ)) {
+        ++j;
+    }
+    if (storedZ < runnerHitBox(player_.pose, scrollAfter(j)).maxZ)
+        return ticks_ + j + 1;
+    return NEVER;
+}
+
+// brings collisionTicks_ up to date with the current cubes, scroll and runner
+void GameWorld::syncCollisionTicks() {
+    CollisionKey key;
+    key.epoch = cubeEpoch_;
+    key.spawned = cubesSpawned_;
+    key.scrollOrigin = ticks_ - scrollTicks_;
+    key.scrollBase = scrollBase_;
+    key.scrollIncr = scrollIncr_;
+    key.runnerX = player_.pose.x;
+    key.runnerY = player_.pose.height;
+
+    const bool sameState = key.epoch == collisionKey_.epoch && key.scrollOrigin == collisionKey_.scrollOrigin &&
+                           key.scrollBase == collisionKey_.scrollBase && key.scrollIncr == collisionKey_.scrollIncr &&
+                           key.runnerX == collisionKey_.runnerX && key.runnerY == collisionKey_.runnerY;
+    if (sameState && key.spawned == collisionKey_.spawned + 1) {
+        // the only change is the cube spawned by the last step
+        const long long tick = collisionTick(lastSpawn_[0], lastSpawn_[1], lastSpawn_[2]);
+        if (tick != NEVER) {
+            collisionTicks_.push(tick);
+        }
+    }
+    else if (!sameState || key.spawned != collisionKey_.spawned) {
+        collisionTicks_ = CollisionTickQueue();
+        for (int layer = 0; layer < NUM_LAYERS; layer++) {
+            const CubeStore& cubes = cubes_[layer];
+            for (int i = 0; i < cubes.size(); i++) {
+                const long long tick = collisionTick(cubes.x()[i], cubes.y()[i], cubes.z()[i]);
+                if (tick != NEVER) {
+                    collisionTicks_.push(tick);
+                }
+            }
+        }
+    }
+    collisionKey_ = key;
+
+    while (!collisionTicks_.empty() && collisionTicks_.top() <= ticks_) {
+        collisionTicks_.pop();
+    }
+}
+
+// advances k ticks in which nothing but the counters and the scroll change
+void GameWorld::skipTicks(const long long k) {
+    if (k <= 0)
+        return;
+    ticks_ += k;
+    advanceScroll((int)k);
+    spinTick_ += (int)k;
+}
+
+unsigned GameWorld::fastForward(const long long maxTicks) {
+    const GameInput noInput;
+    const long long endTick = ticks_ + maxTicks;
+    while (ticks_ < endTick) {
+        if (scrollIncr_ != scrollPerTick()) {
+            // what the next step would do first anyway
+            restartScroll();
+        }
+
+        if (isRunnerAtRest()) {
+            syncCollisionTicks();
+            long long next = min(schedule_.nextTick(), ticks_ + ticksToRebase());
+            if (patterns_) {
+                next = min(next, ticks_ + ticksToNextChunk());
+            }
+            if (!collisionTicks_.empty()) {
+                next = min(next, collisionTicks_.top());
+            }
+            skipTicks(min(next, endTick) - 1 - ticks_);
+        }
+
+        const unsigned events = step(noInput);
+        if (events)
+            return events;
+    }
+    return 0;
+}
@@ -0,0 +1,393 @@
+#ifndef GAMEWORLD_H
+#define GAMEWORLD_H
+
+#include <queue>
+#include <vector>
+#include <functional>
+
+#include "cvec.h"
+#include "quat.h"
+#include "rigtform.h"
+#include "cubestore.h"
+#include "cubegrid.h"
+#include "occupancy.h"
+#include "rng.h"
+#include "timingwheel.h"
+#include "spawner.h"
+#include "patterns.h"
+
+// Simulation core of the game. Nothing in here touches GL or GLUT, so the
+// world can be stepped from the GLUT timer or from a plain loop (--headless).
+
+// C O N S T A N T S ///////////////////////////////////////////////////
+
+static const float g_groundY = -.05;      // y coordinate of the ground
+static const float g_cubeSideLength = .22;
+static const float g_runnerZ = 3.5;
+static const float g_cubeDespawnZ = 4.0 + g_cubeSideLength; // cubes behind the camera (sky z is always 4) are removed
+
+// gameplay constants
+static const float g_furthestCubeZ = -3.0;
+static const float g_nearestCubeZ = 1.0;
+static const float g_zRange = g_nearestCubeZ - g_furthestCubeZ;
+static const float g_xTranslationAmount = .05;
+static const float g_maxRotationAngle = 35; // max screen tilt angle in degrees
+static const float g_tiltAmount = 1;        // degrees the screen tilts while swerving
+static const float g_untiltAmount = 3;      // degrees it tilts back once the arrow is released
+static const float g_levelTilt = 1.15;      // degrees within which the tilt snaps back to level
+
+// simulation constants. Amounts "per tick" here and above are for a tick at
+// the default g_simulationsPerSecond; a world running at another tick rate
+// scales them by the length of its tick, so the game plays the same at any
+// rate. Spawn intervals are counted in default ticks too.
+static const int g_simulationsPerSecond = 40;
+static const int g_minSimulationsPerSecond = 20;
+static const int g_maxSimulationsPerSecond = 1000;
+static const int g_simRateOriginal = 5;
+static const int g_simRateLowBound = 2;
+static const float g_cubeIncrDisMin = .06;
+static const float g_cubeIncrDisMax = .1;
+static const float g_cubeIncrDisFloor = .02; // the 'v' key never slows cubes below this
+static const float g_cubeSpinPerTick = 100;       // degrees each cube spins per simulation
+static const float g_scrollRebaseDistance = 256;  // scroll distance at which cube z values are rebased to keep float precision
+
+// jump constants
+static const float g_jumpPeak = g_cubeSideLength + .5; // high enough to jump over a cube
+static const float g_jumpAmount = .1;
+
+static const float g_skyHeight = .25; // camera height above the runner
+static const float g_skyZ = 4.0;
+
+// Where the player is, which is all the camera and runner transforms are
+// built from. The runner hangs below the camera and tilts with it.
+struct PlayerPose {
+  float x;      // offset of the camera and runner across the field
+  float tilt;   // screen tilt about the view axis in degrees, positive while swerving left
+  float height; // height of the jump
+
+  RigTForm skyRbt() const {
+    return RigTForm(Cvec3(x, g_skyHeight + height, g_skyZ), Quat::makeZRotation(tilt));
+  }
+  RigTForm runnerRbt() const {
+    return skyRbt() * RigTForm(Cvec3(0, -g_skyHeight, -g_skyZ));
+  }
+};
+
+// The pose and what the player is in the middle of, everything GameWorld
+// moves in response to input
+struct PlayerState {
+  PlayerPose pose;
+  bool jumpInProgress;
+  bool jumpPeakReached;
+};
+
+inline PlayerPose lerp(const PlayerPose& a, const PlayerPose& b, const float alpha) {
+  PlayerPose r;
+  r.x = a.x + (b.x - a.x) * alpha;
+  r.tilt = a.tilt + (b.tilt - a.tilt) * alpha;
+  r.height = a.height + (b.height - a.height) * alpha;
+  return r;
+}
+
+class Planner;
+class LatencyHistogram;
+
+// Input applied by a single call to GameWorld::step()
+struct GameInput {
+  bool left;  // left arrow held
+  bool right; // right arrow held
+  bool jump;  // jump pressed since the last step
+
+  GameInput() : left(false), right(false), jump(false) {}
+};
+
+// Bit flags returned by GameWorld::step() describing what happened in the tick
+enum {
+  GAME_EVENT_COLLISION = 1 << 0,  // runner hit a cube, the game is now stopped
+  GAME_EVENT_SPEED_UP = 1 << 1,   // tutorial increased the cube-generation rate
+  GAME_EVENT_NORMAL_MODE = 1 << 2 // tutorial finished, normal gameplay started
+};
+
+// Player commands that change the world between ticks. They go through
+// GameWorld::applyCommand() so a recording can replay them (see inputlog.h).
+enum GameCommand {
+  GAME_COMMAND_TUTORIAL_MODE,
+  GAME_COMMAND_NORMAL_MODE,
+  GAME_COMMAND_DEATH_MODE,
+  GAME_COMMAND_RESTART,
+  GAME_COMMAND_INCREASE_SPEED,
+  GAME_COMMAND_DECREASE_SPEED,
+  GAME_COMMAND_INCREASE_CUBE_GEN_RATE,
+  GAME_COMMAND_DECREASE_CUBE_GEN_RATE,
+  GAME_COMMAND_MOVE_CUBES_FORWARD,
+  GAME_COMMAND_MOVE_CUBES_BACK,
+  GAME_COMMAND_SET_AUTONOMOUS,       // value is 0 or 1
+  GAME_COMMAND_SET_CUBE_FIELD_WIDTH, // value is the width
+  NUM_GAME_COMMANDS
+};
+
+// The state of a GameWorld that the rest of it is derived from, flattened:
+// the scalars in a plain struct and the cubes of every layer one after the
+// other in shared arrays. Saving into a snapshot that is reused only copies
+// memory once its arrays have grown to the field's size.
+struct WorldSnapshot {
+  struct Scalars {
+    PlayerPose pose, prevPose;
+    float scroll, prevScroll, scrollBase, scrollIncr;
+    int spinTick, prevSpinTick, scrollTicks;
+    float groundX, prevGroundX, cubeFieldLeftSide, cubeFieldWidth;
+    long long ticks, nextSpawnTime;
+    int colorLevel, simulationsPerCubeGen;
+    float secondsPerLevel, cubeIncrDis;
+    bool gameOn, tutorialMode, rgbCubesMode, deathMode, autonomous;
+    bool jumpInProgress, jumpPeakReached;
+    unsigned long long seed;
+    Rng rng;
+    long long cubesSpawned;
+    float lastSpawn[3];
+    float chunkZ;
+    int nextPattern;
+    Rng patternRng;
+  } scalars;
+
+  std::vector<int> layerSizes;
+  std::vector<float> x, y, z;
+  std::vector<int> spawnTick;
+  std::vector<unsigned> color;
+  std::vector<TimingWheel::Entry> scheduled;
+};
+
+class GameWorld {
+public:
+  static const int NUM_LAYERS = 7;
+
+  GameWorld();
+
+  // returns to the state of a new world with the given seed, reusing the
+  // storage already allocated
+  void reset(unsigned long long seed);
+
+  // Advances the simulation by one tick and returns a mask of GAME_EVENT_* flags
+  unsigned step(const GameInput& input);
+
+  // Same as calling step(GameInput()) up to maxTicks times, stopping after the
+  // first tick that returns events, which are returned. While the runner is
+  // at rest it jumps straight over the ticks in which nothing can happen,
+  // so an idle game costs O(events) instead of O(ticks).
+  unsigned fastForward(long long maxTicks);
+
+  // mode changes
+  void startTutorialMode();
+  void startNormalMode();
+  void startDeathMode();
+  void restart(); // clears the field and resumes after a collision
+
+  // speed and cube-generation rate changes, return false if not allowed in the current mode
+  bool increaseSpeed();
+  bool decreaseSpeed();
+  bool increaseCubeGenRate();
+  bool decreaseCubeGenRate();
+
+  // shifts every cube by one tick's distance without simulating; the keys
+  // that did this now rewind (see rewind.h), older recordings still use it
+  void moveCubesForward();
+  void moveCubesBack();
+
+  // calls the method matching command and returns its result (true for the void ones)
+  bool applyCommand(GameCommand command, float value = 0);
+
+  // Copies the world into snapshot, and back. Restoring puts the world in
+  // exactly the saved state: stepping it from there gives the same game as
+  // stepping it from the moment it was saved.
+  void saveSnapshot(WorldSnapshot& snapshot) const;
+  void restoreSnapshot(const WorldSnapshot& snapshot);
+
+  // Sets the tick rate, between g_minSimulationsPerSecond and
+  // g_maxSimulationsPerSecond, and starts the spawn and level timers over.
+  // It is kept by reset(), and a game replays only at the rate it was played.
+  void setSimulationsPerSecond(int simulationsPerSecond);
+
+  // restarts the cube stream from seed; the same seed and inputs give the same game
+  void setSeed(unsigned long long seed) { seed_ = seed; rng_.setSeed(seed); patternRng_.setSeed(~seed); }
+  void setAutonomous(bool autonomous) { autonomous_ = autonomous; clearLaneTimes(); }
+  void setCubeFieldWidth(float width) { cubeFieldWidth_ = width; }
+  // cubes are drawn ahead by spawner, or on the tick if it is NULL; the game
+  // is the same either way
+  void setSpawnPregenerator(SpawnPregenerator* spawner) { spawner_ = spawner; }
+  // fills the field with chunks of patterns from library instead of single
+  // cubes, or goes back to single cubes if it is NULL; the library must
+  // outlive the world
+  void setPatternLibrary(const PatternLibrary* library) { patterns_ = library; clearCubes(); }
+  // while autonomous, the runner is steered by planner instead of the
+  // built-in rules if it is set
+  void setPlanner(Planner* planner) { planner_ = planner; clearLaneTimes(); }
+  // while autonomous, step() adds the time it spends deciding each tick's
+  // input to times if it is set
+  void setDecisionTimes(LatencyHistogram* times) { decisionTimes_ = times; }
+
+  bool isAutonomous() const { return autonomous_; }
+  bool isGameOn() const { return gameOn_; }
+  bool isTutorialMode() const { return tutorialMode_; }
+  bool isRgbCubesMode() const { return rgbCubesMode_; }
+  bool isDeathMode() const { return deathMode_; }
+  float getCubeFieldWidth() const { return cubeFieldWidth_; }
+  int getSimulationsPerCubeGen() const { return simulationsPerCubeGen_; }
+  int getSimulationsPerSecond() const { return simulationsPerSecond_; }
+  long long getTicks() const { return ticks_; }
+  unsigned long long getSeed() const { return seed_; }
+
+  const PlayerState& getPlayer() const { return player_; }
+  const PlayerPose& getPose() const { return player_.pose; }
+  RigTForm getSkyRbt() const { return player_.pose.skyRbt(); }
+  RigTForm getRunnerRbt() const { return player_.pose.runnerRbt(); }
+  float getGroundX() const { return groundX_; }
+
+  // a cube's current z is its stored z plus the scroll distance
+  float getScroll() const { return scroll_; }
+  // spin about y in degrees of a cube spawned on spawnTick
+  float getCubeSpin(int spawnTick) const { return getCubeSpinPerTick() * (spinTick_ - spawnTick); }
+  float getCubeSpinPerTick() const { return g_cubeSpinPerTick * tickScale_; }
+
+  // The same state alpha of the way from the previous tick to the current
+  // one, for drawing frames between ticks. alpha = 1 is the current state.
+  PlayerPose getPose(float alpha) const { return lerp(prevPose_, player_.pose, alpha); }
+  float getGroundX(float alpha) const { return prevGroundX_ + (groundX_ - prevGroundX_) * alpha; }
+  float getScroll(float alpha) const { return prevScroll_ + (scroll_ - prevScroll_) * alpha; }
+  float getCubeSpin(int spawnTick, float alpha) const {
+    return getCubeSpinPerTick() * (prevSpinTick_ + (spinTick_ - prevSpinTick_) * alpha - spawnTick);
+  }
+
+  const CubeStore& getCubes(int layer) const { return cubes_[layer]; }
+
+  // Seconds until the nearest cube of each lane that hasn't passed the runner
+  // reaches the front of it at the current speed, 0 for a cube it is level
+  // with and FLT_MAX for none within the autopilot's one second horizon or a
+  // field that isn't moving. The lanes are NUM_LAYERS strips across the field
+  // where it is now, so the middle one is the runner's. Only the nearest cube
+  // of each layer is counted, in the lane it is in now. step() works them out
+  // only on the ticks the autopilot steers; otherwise, and once the cubes are
+  // cleared or a snapshot restored, they are all FLT_MAX.
+  const float* getLaneTimesToCollision() const { return laneTimes_; }
+
+  // Questions for looking ahead (see planner.h), none of which change the world.
+  // moves player as a tick with input would and returns how far the rest of
+  // the screen shifts the other way
+  float movePlayer(PlayerState& player, const GameInput& input) const;
+  // scroll after n more ticks at the current speed
+  float predictScroll(int n) const {
+    return scrollIncr_ == scrollPerTick() ? scrollAfter(n) : scroll_ + scrollPerTick() * (float)n;
+  }
+  // true if the runner hits a cube moving from pose `from` at scrollFrom to `to` at scrollTo
+  bool runnerHits(const PlayerPose& from, float scrollFrom, const PlayerPose& to, float scrollTo) const {
+    return detectCollision(runnerHitBox(from, scrollFrom), runnerHitBox(to, scrollTo));
+  }
+  // how far the runner at pose can go at scroll before a cube may be in its
+  // way, up to maxDistance
+  float clearanceAhead(const PlayerPose& pose, float scroll, float maxDistance) const {
+    return occupancy_.clearDistance(runnerHitBox(pose, scroll), maxDistance);
+  }
+
+private:
+  bool dispatchCommand(GameCommand command, float value);
+  void savePreviousTick();
+  void setCubeIncrDis();
+  float scrollPerTick() const { return cubeIncrDis_ * tickScale_; }
+  void restartScroll();
+  float scrollAfter(int n) const;
+  void advanceScroll(int n);
+  HitBox runnerHitBox(const PlayerPose& pose, float scroll) const;
+  HitBox cubeFootprint(float x, float y, float storedZ) const;
+  bool isRunnerAtRest() const;
+  long long ticksToRebase() const;
+  long long collisionTick(float x, float y, float storedZ) const;
+  void syncCollisionTicks();
+  void skipTicks(long long k);
+  void clearCubes();
+  void rebaseScroll();
+  void rebuildCubeIndexes(float zLimit);
+  int ticksPerLevel() const;
+  void restartSchedule();
+  unsigned runScheduledEvents();
+  SpawnRecord nextSpawn();
+  void addCube();
+  void streamPatterns();
+  void splicePattern(int pattern);
+  long long ticksToNextChunk() const;
+  bool detectCollision(const HitBox& from, const HitBox& to) const;
+  float threatReach() const;
+  void clearLaneTimes();
+  void trackLanes();
+  void autopilot(GameInput& input);
+  float moveLeft(PlayerState& player) const;
+  float moveRight(PlayerState& player) const;
+  void resetScreenRotation(PlayerState& player) const;
+  void jump(PlayerState& player) const;
+  void descend(PlayerState& player) const;
+  void handleJump(PlayerState& player) const;
+
+  PlayerState player_;  // camera and runner
+  PlayerPose prevPose_; // as of the previous tick, for interpolation
+
+  CubeStore cubes_[NUM_LAYERS]; // holds cubes and their colors
+  CubeGrid grid_;               // broad-phase index of the same cubes for collision
+  float laneTimes_[NUM_LAYERS]; // see getLaneTimesToCollision()
+  OccupancyField occupancy_;    // bitmap of where the cubes' footprints reach, to rule out collisions and threats quickly
+  float scroll_;                // distance every cube has moved since the last rebase
+  int spinTick_;                // ticks of spin since the last rebase
+  float prevScroll_;            // scroll_ and spinTick_ as of the previous tick
+  int prevSpinTick_;
+  float scrollBase_;            // scroll_ is scrollBase_ + scrollIncr_ * scrollTicks_
+  float scrollIncr_;
+  int scrollTicks_;
+
+  float groundX_;           // x coordinate of ground (the lights follow it too)
+  float prevGroundX_;
+  float cubeFieldLeftSide_;
+  float cubeFieldWidth_;
+
+  long long ticks_;           // total number of steps taken
+  int simulationsPerSecond_;  // tick rate
+  float tickScale_;           // default ticks per tick, what the per-tick amounts are scaled by
+  long long nextSpawnTime_;   // time of the next spawn, in ticks times g_simulationsPerSecond
+  TimingWheel schedule_;      // upcoming spawns, color-level changes and tutorial speed-ups
+  std::vector<int> dueEvents_; // schedule_ events due on the current tick
+  int colorLevel_;            // 0, 1, 2 for red, green, blue cubes in RGB mode
+  int simulationsPerCubeGen_; // number of default ticks that pass for each generated cube
+  float secondsPerLevel_;     // seconds before speed increases in tutorial mode or color changes in normal gameplay mode
+  float cubeIncrDis_;         // the distance each cube moves per default tick
+  bool gameOn_;               // false once the runner has collided with a cube
+
+  // game modes
+  bool tutorialMode_;
+  bool rgbCubesMode_;
+  bool deathMode_;
+
+  bool autonomous_; // AI plays game
+
+
+  unsigned long long seed_; // seed the cube stream was started from
+  Rng rng_;                 // cube positions and colors
+  SpawnPregenerator* spawner_; // draws from rng_ ahead of time if set
+  Planner* planner_;           // steers instead of autopilot() if set
+  LatencyHistogram* decisionTimes_; // see setDecisionTimes()
+
+  // pattern chunks, streamed in as the near edge of the field reaches them
+  const PatternLibrary* patterns_; // NULL to spawn single cubes
+  Rng patternRng_;                 // which pattern comes next
+  int nextPattern_;                // pattern of the next chunk, -1 until drawn
+  float chunkZ_;                   // stored z of the next chunk's near edge
+
+  // fast-forward bookkeeping
+  typedef std::priority_queue<long long, std::vector<long long>, std::greater<long long> > CollisionTickQueue;
+  struct CollisionKey {      // state collisionTicks_ was computed for
+    long long epoch, spawned, scrollOrigin;
+    float scrollBase, scrollIncr, runnerX, runnerY;
+  };
+  long long cubeEpoch_;                // bumped when cubes are cleared or rebased
+  long long cubesSpawned_;             // cubes spawned so far
+  float lastSpawn_[3];                 // x, y and stored z of the last cube spawned
+  CollisionTickQueue collisionTicks_;  // ticks on which a cube will hit the runner at rest
+  CollisionKey collisionKey_;
+};
+
+#endif
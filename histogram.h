@@ -0,0 +1,82 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// Counts durations in buckets a sixteenth of a power of two wide, from a
+// nanosecond to about a minute. Percentiles of any number of samples come
+// back to within a few percent from a fixed set of counters, and histograms
+// filled on different threads combine by adding them up with merge().
+class LatencyHistogram {
+public:
+  LatencyHistogram() { clear(); }
+
+  void clear() {
+    memset(counts_, 0, sizeof(counts_));
+    count_ = 0;
+    sum_ = 0;
+  }
+
+  void add(const double seconds) {
+    ++counts_[bucket(seconds * 1e9)];
+    ++count_;
+    sum_ += seconds;
+  }
+
+  void merge(const LatencyHistogram& other) {
+    for (int i = 0; i < NUM_BUCKETS; ++i) {
+      counts_[i] += other.counts_[i];
+    }
+    count_ += other.count_;
+    sum_ += other.sum_;
+  }
+
+  long long count() const { return count_; }
+
+  // exact, from the sum of the samples
+  double mean() const { return count_ ? sum_ / count_ : 0; }
+
+  // the sample at fraction p (0 to 1) of the way through, as the middle of
+  // its bucket, in seconds; 0 with no samples
+  double percentile(const double p) const {
+    if (count_ == 0)
+      return 0;
+    const long long rank = std::max(1LL, (long long)std::ceil(p * count_));
+    long long seen = 0;
+    for (int i = 0; i < NUM_BUCKETS; ++i) {
+      seen += counts_[i];
+      if (seen >= rank)
+        return .5 * (bucketStart(i) + bucketStart(i + 1)) * 1e-9;
+    }
+    return bucketStart(NUM_BUCKETS) * 1e-9;
+  }
+
+private:
+  enum { SUB_BUCKETS = 16, OCTAVES = 36, NUM_BUCKETS = 1 + OCTAVES * SUB_BUCKETS };
+
+  // bucket 0 holds everything under a nanosecond, the last everything past 2^36 ns
+  static int bucket(const double ns) {
+    if (!(ns >= 1))
+      return 0;
+    int exponent;
+    const double mantissa = std::frexp(ns, &exponent); // ns = mantissa * 2^exponent, mantissa in [.5, 1)
+    const int b = 1 + (exponent - 1) * SUB_BUCKETS + (int)((2 * mantissa - 1) * SUB_BUCKETS);
+    return std::min(b, NUM_BUCKETS - 1);
+  }
+
+  // nanoseconds where bucket b starts
+  static double bucketStart(const int b) {
+    if (b == 0)
+      return 0;
+    const int octave = (b - 1) / SUB_BUCKETS;
+    return std::ldexp(1 + (double)((b - 1) % SUB_BUCKETS) / SUB_BUCKETS, octave);
+  }
+
+  long long counts_[NUM_BUCKETS];
+  long long count_;
+  double sum_;
+};
+
+#endif
@@ -0,0 +1,237 @@
+#include <cstring>
+#include <vector>
+#include <iterator>
+#include <stdexcept>
+
+#include "inputlog.h"
+
+using namespace std;
+
+static const char g_inputLogMagic[4] = {'C', 'R', 'I', 'N'};
+static const unsigned char g_inputLogVersion = 2; // 1 had no tick rate and ran at g_simulationsPerSecond
+
+enum {
+  TICK_LEFT = 1 << 0,
+  TICK_RIGHT = 1 << 1,
+  TICK_JUMP = 1 << 2,
+  COMMAND_RECORD = 1 << 7
+};
+
+unsigned char packTickInput(const GameInput& input) {
+  return (input.left ? TICK_LEFT : 0) | (input.right ? TICK_RIGHT : 0) | (input.jump ? TICK_JUMP : 0);
+}
+
+GameInput unpackTickInput(const unsigned char record) {
+  GameInput input;
+  input.left = (record & TICK_LEFT) != 0;
+  input.right = (record & TICK_RIGHT) != 0;
+  input.jump = (record & TICK_JUMP) != 0;
+  return input;
+}
+
+static unsigned floatBits(const float value) {
+  unsigned bits;
+  memcpy(&bits, &value, sizeof(bits));
+  return bits;
+}
+
+static float bitsFloat(const unsigned bits) {
+  float value;
+  memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+// little-endian, as every float of a recording
+static void putFloat(const float value, unsigned char bytes[4]) {
+  const unsigned bits = floatBits(value);
+  for (int i = 0; i < 4; ++i) {
+    bytes[i] = (unsigned char)(bits >> (8 * i));
+  }
+}
+
+static float getFloat(const unsigned char bytes[4]) {
+  unsigned bits = 0;
+  for (int i = 0; i < 4; ++i) {
+    bits |= (unsigned)bytes[i] << (8 * i);
+  }
+  return bitsFloat(bits);
+}
+
+void packCommand(const GameCommand command, const float value, unsigned char record[g_commandRecordSize]) {
+  record[0] = (unsigned char)(COMMAND_RECORD | command);
+  putFloat(value, record + 1);
+}
+
+bool isCommandRecord(const unsigned char first) {
+  return (first & COMMAND_RECORD) != 0;
+}
+
+GameCommand unpackCommand(const unsigned char record[g_commandRecordSize], float& value) {
+  value = getFloat(record + 1);
+  return (GameCommand)(record[0] & ~COMMAND_RECORD);
+}
+
+InputRecorder::InputRecorder(const char* filename, const GameWorld& world)
+  : f_(filename, ios::binary)
+{
+  if (!f_)
+    throw runtime_error(string("InputRecorder: cannot open ") + filename);
+
+  f_.write(g_inputLogMagic, sizeof(g_inputLogMagic));
+  f_.put(g_inputLogVersion);
+  const unsigned long long seed = world.getSeed();
+  for (int i = 0; i < 8; ++i) {
+    f_.put((char)(seed >> (8 * i)));
+  }
+  f_.put(world.isAutonomous() ? 1 : 0);
+  unsigned char width[4];
+  putFloat(world.getCubeFieldWidth(), width);
+  f_.write((const char*)width, sizeof(width));
+  const unsigned simulationsPerSecond = world.getSimulationsPerSecond();
+  for (int i = 0; i < 4; ++i) {
+    f_.put((char)(simulationsPerSecond >> (8 * i)));
+  }
+}
+
+void InputRecorder::recordTick(const GameInput& input) {
+  f_.put((char)packTickInput(input));
+}
+
+void InputRecorder::recordCommand(const GameCommand command, const float value) {
+  unsigned char record[g_commandRecordSize];
+  packCommand(command, value, record);
+  f_.write((const char*)record, sizeof(record));
+}
+
+// Reads a recording: the header on construction, then one record at a time.
+// The whole file is read up front so the replay loops never wait on I/O.
+class InputLogReader {
+public:
+  explicit InputLogReader(const char* filename) : pos_(0) {
+    ifstream f(filename, ios::binary);
+    if (!f)
+      throw runtime_error(string("InputLogReader: cannot open ") + filename);
+    data_.assign(istreambuf_iterator<char>(f), istreambuf_iterator<char>());
+
+    for (int i = 0; i < (int)sizeof(g_inputLogMagic); ++i) {
+      if (byte() != (unsigned char)g_inputLogMagic[i])
+        throw runtime_error(string("InputLogReader: not an input recording: ") + filename);
+    }
+    const unsigned char version = byte();
+    if (version < 1 || version > g_inputLogVersion)
+      throw runtime_error(string("InputLogReader: unsupported version: ") + filename);
+    seed_ = integer(8);
+    autonomous_ = byte() != 0;
+    cubeFieldWidth_ = real();
+    simulationsPerSecond_ = version >= 2 ? (int)integer(4) : g_simulationsPerSecond;
+  }
+
+  unsigned long long seed() const { return seed_; }
+  bool autonomous() const { return autonomous_; }
+  float cubeFieldWidth() const { return cubeFieldWidth_; }
+  int simulationsPerSecond() const { return simulationsPerSecond_; }
+
+  bool atEnd() const { return pos_ == data_.size(); }
+
+  // reads the next record: returns true and fills input for a tick, or false
+  // and fills command and value for a command
+  bool next(GameInput& input, GameCommand& command, float& value) {
+    unsigned char record[g_commandRecordSize];
+    record[0] = byte();
+    if (isCommandRecord(record[0])) {
+      for (int i = 1; i < g_commandRecordSize; ++i) {
+        record[i] = byte();
+      }
+      command = unpackCommand(record, value);
+      if (command >= NUM_GAME_COMMANDS)
+        throw runtime_error("InputLogReader: invalid command");
+      return false;
+    }
+    input = unpackTickInput(record[0]);
+    return true;
+  }
+
+private:
+  unsigned char byte() {
+    if (atEnd())
+      throw runtime_error("InputLogReader: truncated file");
+    return data_[pos_++];
+  }
+
+  unsigned long long integer(const int bytes) {
+    unsigned long long value = 0;
+    for (int i = 0; i < bytes; ++i) {
+      value |= (unsigned long long)byte() << (8 * i);
+    }
+    return value;
+  }
+
+  float real() {
+    return bitsFloat((unsigned)integer(4));
+  }
+
+  vector<unsigned char> data_;
+  size_t pos_;
+  unsigned long long seed_;
+  bool autonomous_;
+  float cubeFieldWidth_;
+  int simulationsPerSecond_;
+};
+
+ReplayStats replayInput(const char* filename, GameWorld& world) {
+  InputLogReader in(filename);
+  world.setSimulationsPerSecond(in.simulationsPerSecond());
+  world.reset(in.seed());
+  world.setAutonomous(in.autonomous());
+  world.setCubeFieldWidth(in.cubeFieldWidth());
+
+  ReplayStats stats = {0, 0};
+  GameInput input;
+  GameCommand command;
+  float value;
+  long long idleTicks = 0; // run of ticks with no input not yet simulated
+  while (true) {
+    const bool atEnd = in.atEnd();
+    const bool tick = !atEnd && in.next(input, command, value);
+    if (tick && !input.left && !input.right && !input.jump) {
+      ++idleTicks;
+      continue;
+    }
+
+    // a run of idle ticks is fast-forwarded in one go
+    const long long endTick = world.getTicks() + idleTicks;
+    while (world.getTicks() < endTick) {
+      if (world.fastForward(endTick - world.getTicks()) & GAME_EVENT_COLLISION) {
+        ++stats.collisions;
+      }
+    }
+    stats.ticks += idleTicks;
+    idleTicks = 0;
+
+    if (atEnd)
+      break;
+    if (tick) {
+      if (world.step(input) & GAME_EVENT_COLLISION) {
+        ++stats.collisions;
+      }
+      ++stats.ticks;
+    }
+    else {
+      world.applyCommand(command, value);
+    }
+  }
+  return stats;
+}
+
+void loadTickInputs(const char* filename, vector<GameInput>& inputs) {
+  InputLogReader in(filename);
+  inputs.clear();
+  GameInput input;
+  GameCommand command;
+  float value;
+  while (!in.atEnd()) {
+    if (in.next(input, command, value)) {
+      inputs.push_back(input);
+    }
+  }
+}
@@ -0,0 +1,57 @@
+#ifndef INPUTLOG_H
+#define INPUTLOG_H
+
+#include <fstream>
+#include <vector>
+
+#include "gameworld.h"
+
+// Binary recording of a game: everything needed to reproduce it from a fresh
+// GameWorld.
+//
+// The header holds the magic "CRIN", a format version byte, the RNG seed
+// (8 bytes), the autonomous flag (1 byte), the cube field width (4 bytes) and
+// the tick rate (4 bytes, not in version 1 recordings, which ran at 40 Hz).
+// After it comes one record per tick or command, in the order they happened:
+//   0x00-0x7f  a tick, bit 0 left held, bit 1 right held, bit 2 jump pressed
+//   0x80 | c   GameCommand c, followed by its value (4 bytes)
+// Integers and floats are stored little-endian.
+
+// the tick record of an input, and back
+unsigned char packTickInput(const GameInput& input);
+GameInput unpackTickInput(unsigned char record);
+
+// the record of a command and its value, and back; isCommandRecord() tells
+// one from a tick record by its first byte
+static const int g_commandRecordSize = 5;
+void packCommand(GameCommand command, float value, unsigned char record[g_commandRecordSize]);
+bool isCommandRecord(unsigned char first);
+GameCommand unpackCommand(const unsigned char record[g_commandRecordSize], float& value);
+
+class InputRecorder {
+public:
+  // writes the header for the current state of world. Throws on error.
+  InputRecorder(const char* filename, const GameWorld& world);
+
+  void recordTick(const GameInput& input);
+  void recordCommand(GameCommand command, float value);
+
+private:
+  std::ofstream f_;
+};
+
+// counts from a replay
+struct ReplayStats {
+  long long ticks;
+  long long collisions;
+};
+
+// Resets world to the recorded start state, then feeds it every recorded tick
+// and command with no pacing. Throws on a missing or malformed file.
+ReplayStats replayInput(const char* filename, GameWorld& world);
+
+// Reads just the per-tick inputs of a recording, dropping the header and
+// commands, so they can drive other games. Throws like replayInput.
+void loadTickInputs(const char* filename, std::vector<GameInput>& inputs);
+
+#endif
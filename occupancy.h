@@ -0,0 +1,169 @@
+#ifndef OCCUPANCY_H
+#define OCCUPANCY_H
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#if defined(__SSE2__)
+#   include <emmintrin.h>
+#endif
+
+#include "collision.h"
+
+// Bitmap of the cube field: one bit per cell of a grid over world x and
+// stored z, set wherever some cube's footprint reaches. Each z row is one
+// 256-bit word of columns, so the occupancy of a whole stretch of the field
+// is the OR of its rows, two 128-bit words at a time with SSE2.
+//
+// Like CubeGrid, rows and columns are indexed modulo the grid size and rows
+// are in stored z, so the field slides past the bitmap instead of being
+// shifted: advancing the world only clears the rows that scrolled out behind
+// the camera. Cells shared by far-apart parts of the field only ever add
+// bits, so a clear cell is always truly free and a set one is a candidate for
+// the exact test. If the footprints ever span more rows than the bitmap has
+// (the cubes were moved back by hand), dropping a row could clear a live one,
+// so the field counts as fully occupied until the next clear().
+class OccupancyField {
+public:
+  static const int NUM_ROWS = 256; // z cells, must be a power of two
+  static const int NUM_COLS = 256; // x cells, one row word
+  static const int ROW_WORDS = NUM_COLS / 64;
+
+  // the columns of one row, bit c % 64 of word c / 64 for column c
+  struct Row {
+    unsigned long long word[ROW_WORDS];
+  };
+
+  OccupancyField(const float cellWidth, const float cellDepth)
+    : cellWidth_(cellWidth), cellDepth_(cellDepth), topRow_(0), bottomRow_(0), saturated_(false) {
+    clear(0);
+  }
+
+  // clears every cell; zLimit is the stored z past which rows are dropped
+  void clear(const float zLimit) {
+    memset(rows_, 0, sizeof(rows_));
+    topRow_ = row(zLimit);
+    bottomRow_ = topRow_;
+    saturated_ = false;
+  }
+
+  // marks the cells the box reaches
+  void insert(const HitBox& box) {
+    Row mask;
+    columnMask(col(box.minX), col(box.maxX), mask);
+    const int r0 = row(box.minZ), r1 = row(box.maxZ);
+    for (int r = r0; r <= r1; ++r) {
+      Row& dst = rows_[r & (NUM_ROWS - 1)];
+      for (int w = 0; w < ROW_WORDS; ++w) {
+        dst.word[w] |= mask.word[w];
+      }
+    }
+    if (r1 > topRow_) {
+      topRow_ = r1;
+    }
+    if (r0 < bottomRow_) {
+      bottomRow_ = r0;
+    }
+    if (topRow_ - bottomRow_ >= NUM_ROWS) {
+      saturated_ = true;
+    }
+  }
+
+  // clears the rows entirely past zLimit; footprints reaching past zLimit
+  // lose those cells, so zLimit should be a box's depth behind the last
+  // place queried
+  void despawnFrom(const float zLimit) {
+    const int limitRow = row(zLimit);
+    topRow_ = std::min(topRow_, limitRow + int(NUM_ROWS)); // more rows would wrap round
+    for (; topRow_ > limitRow; --topRow_) {
+      memset(&rows_[topRow_ & (NUM_ROWS - 1)], 0, sizeof(Row));
+    }
+  }
+
+  // ORs the rows from minZ to maxZ into out
+  void occupiedColumns(const float minZ, const float maxZ, Row& out) const {
+    int r0 = row(minZ), r1 = row(maxZ);
+    if (r1 - r0 >= NUM_ROWS) {
+      r1 = r0 + NUM_ROWS - 1;
+    }
+#if defined(__SSE2__)
+    __m128i lo = _mm_setzero_si128(), hi = _mm_setzero_si128();
+    for (int r = r0; r <= r1; ++r) {
+      const __m128i* src = (const __m128i*)&rows_[r & (NUM_ROWS - 1)];
+      lo = _mm_or_si128(lo, _mm_load_si128(src));
+      hi = _mm_or_si128(hi, _mm_load_si128(src + 1));
+    }
+    _mm_storeu_si128((__m128i*)&out.word[0], lo);
+    _mm_storeu_si128((__m128i*)&out.word[2], hi);
+#else
+    memset(&out, 0, sizeof(out));
+    for (int r = r0; r <= r1; ++r) {
+      const Row& src = rows_[r & (NUM_ROWS - 1)];
+      for (int w = 0; w < ROW_WORDS; ++w) {
+        out.word[w] |= src.word[w];
+      }
+    }
+#endif
+  }
+
+  // returns false only if no footprint reaches into the cells of the box's
+  // x and z range
+  bool mayOverlap(const HitBox& box) const {
+    if (saturated_)
+      return true;
+    Row occupied, mask;
+    occupiedColumns(box.minZ, box.maxZ, occupied);
+    columnMask(col(box.minX), col(box.maxX), mask);
+    unsigned long long any = 0;
+    for (int w = 0; w < ROW_WORDS; ++w) {
+      any |= occupied.word[w] & mask.word[w];
+    }
+    return any != 0;
+  }
+
+  // how far from box.minZ towards -z the box can slide, up to maxDistance,
+  // before a footprint may reach into its columns
+  float clearDistance(const HitBox& box, const float maxDistance) const {
+    if (saturated_)
+      return 0;
+    Row mask;
+    columnMask(col(box.minX), col(box.maxX), mask);
+    const int r0 = row(box.maxZ);
+    const int r1 = std::max(row(box.minZ - maxDistance), r0 - NUM_ROWS + 1);
+    for (int r = r0; r >= r1; --r) {
+      const Row& src = rows_[r & (NUM_ROWS - 1)];
+      unsigned long long any = 0;
+      for (int w = 0; w < ROW_WORDS; ++w) {
+        any |= src.word[w] & mask.word[w];
+      }
+      if (any)
+        return std::max(0.f, box.minZ - (r + 1) * cellDepth_);
+    }
+    return maxDistance;
+  }
+
+  int row(const float z) const { return (int)std::floor(z / cellDepth_); }
+  int col(const float x) const { return (int)std::floor(x / cellWidth_); }
+
+private:
+  // the columns c0 to c1, wrapped around the grid
+  static void columnMask(const int c0, const int c1, Row& mask) {
+    if (c1 - c0 >= NUM_COLS - 1) {
+      memset(&mask, 0xff, sizeof(mask));
+      return;
+    }
+    memset(&mask, 0, sizeof(mask));
+    for (int c = c0; c <= c1; ++c) {
+      const int i = c & (NUM_COLS - 1);
+      mask.word[i >> 6] |= 1ULL << (i & 63);
+    }
+  }
+
+  float cellWidth_, cellDepth_;
+  alignas(16) Row rows_[NUM_ROWS];
+  int topRow_;      // highest row that may have bits set
+  int bottomRow_;   // lowest row inserted into since the last clear()
+  bool saturated_;  // rows have wrapped onto live ones
+};
+
+#endif
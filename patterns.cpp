@@ -0,0 +1,227 @@
+#include <cstring>
+#include <cmath>
+#include <vector>
+#include <fstream>
+#include <stdexcept>
+#ifdef _WIN32
+#   include <windows.h>
+#else
+#   include <fcntl.h>
+#   include <unistd.h>
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+#endif
+
+#include "patterns.h"
+#include "gameworld.h"
+
+using namespace std;
+
+static const char g_patternMagic[4] = {'C', 'R', 'P', 'L'};
+static const unsigned g_patternVersion = 1;
+static const float g_minPatternDepth = .25f;
+// A chunk is spliced in once its far edge reaches the far end of the field,
+// so its near edge is depth closer. Deeper than the field, it would put cubes
+// past the despawn line, beyond the span of stored z that CubeGrid and
+// OccupancyField can tell apart.
+static const float g_maxPatternDepth = g_cubeDespawnZ - g_furthestCubeZ;
+
+struct PatternHeader {
+  char magic[4];
+  unsigned version;
+  unsigned numPatterns;
+  unsigned numCubes;
+};
+
+static unsigned byteSwapped(const unsigned v) {
+  return (v >> 24) | ((v >> 8) & 0xff00) | ((v << 8) & 0xff0000) | (v << 24);
+}
+
+PatternLibrary::PatternLibrary(const char* filename)
+  : data_(NULL), size_(0)
+{
+#ifdef _WIN32
+  file_ = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (file_ == INVALID_HANDLE_VALUE)
+    throw runtime_error(string("PatternLibrary: cannot open ") + filename);
+  LARGE_INTEGER fileSize;
+  GetFileSizeEx(file_, &fileSize);
+  size_ = (size_t)fileSize.QuadPart;
+  mapping_ = size_ > 0 ? CreateFileMappingA(file_, NULL, PAGE_READONLY, 0, 0, NULL) : NULL;
+  if (mapping_) {
+    data_ = (const unsigned char*)MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0);
+  }
+#else
+  const int fd = open(filename, O_RDONLY);
+  if (fd < 0)
+    throw runtime_error(string("PatternLibrary: cannot open ") + filename);
+  struct stat st;
+  if (fstat(fd, &st) == 0 && st.st_size > 0) {
+    size_ = (size_t)st.st_size;
+    void* p = mmap(NULL, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p != MAP_FAILED) {
+      data_ = (const unsigned char*)p;
+    }
+  }
+  close(fd);
+#endif
+
+  // only the header and the table sizes are checked here, so loading does
+  // not touch the tables; entries are checked as they are read
+  const char* error = NULL;
+  const PatternHeader* header = (const PatternHeader*)data_;
+  if (!data_ || size_ < sizeof(PatternHeader) || memcmp(header->magic, g_patternMagic, sizeof(g_patternMagic)) != 0) {
+    error = "not a pattern library";
+  }
+  else if (header->version == byteSwapped(g_patternVersion)) {
+    error = "written in the other byte order";
+  }
+  else if (header->version != g_patternVersion) {
+    error = "unsupported version";
+  }
+  else if (header->numPatterns == 0 ||
+           (size_ - sizeof(PatternHeader)) / sizeof(PatternInfo) < header->numPatterns ||
+           (size_ - sizeof(PatternHeader) - header->numPatterns * sizeof(PatternInfo)) / sizeof(PatternCube) < header->numCubes) {
+    error = "truncated file";
+  }
+  else {
+    numPatterns_ = header->numPatterns;
+    numCubes_ = header->numCubes;
+    patterns_ = (const PatternInfo*)(data_ + sizeof(PatternHeader));
+    cubes_ = (const PatternCube*)(patterns_ + numPatterns_);
+  }
+  if (error) {
+    unmap();
+    throw runtime_error(string("PatternLibrary: ") + error + ": " + filename);
+  }
+}
+
+PatternLibrary::~PatternLibrary() {
+  unmap();
+}
+
+void PatternLibrary::unmap() {
+#ifdef _WIN32
+  if (data_) {
+    UnmapViewOfFile(data_);
+  }
+  if (mapping_) {
+    CloseHandle(mapping_);
+  }
+  CloseHandle(file_);
+#else
+  if (data_) {
+    munmap((void*)data_, size_);
+  }
+#endif
+  data_ = NULL;
+}
+
+// a pattern whose cubes are not all in the cube table has none
+int PatternLibrary::numCubes(const int pattern) const {
+  const PatternInfo& p = patterns_[pattern];
+  return p.firstCube <= numCubes_ && p.numCubes <= numCubes_ - p.firstCube ? (int)p.numCubes : 0;
+}
+
+// chunks must have some depth for the field to move past them, and no more
+// than the field holds; NaN gets the least
+float PatternLibrary::depth(const int pattern) const {
+  const float d = patterns_[pattern].depth;
+  return d >= g_minPatternDepth ? (d <= g_maxPatternDepth ? d : g_maxPatternDepth) : g_minPatternDepth;
+}
+
+// x within the field and dz within the chunk; the comparisons are written
+// so that NaN fails them
+PatternCube PatternLibrary::cube(const int pattern, const int i) const {
+  PatternCube c = cubes_[patterns_[pattern].firstCube + i];
+  c.x = c.x >= 0 ? (c.x <= 1 ? c.x : 1) : 0;
+  const float d = depth(pattern);
+  c.dz = c.dz >= 0 ? (c.dz <= d ? c.dz : d) : 0;
+  return c;
+}
+
+// Built-in patterns. The field is about 4 units wide and a cube .22, so
+// cubes .06 of the field apart leave no room to pass, and a gap of .16 lets
+// the runner through.
+
+static const float g_wallSpacing = .06f;
+static const float g_gapHalfWidth = .08f;
+
+struct PatternBuilder {
+  vector<PatternInfo> patterns;
+  vector<PatternCube> cubes;
+
+  void begin() {
+    PatternInfo p = {(unsigned)cubes.size(), 0, 0};
+    patterns.push_back(p);
+  }
+  void add(const float x, const float dz) {
+    PatternCube c = {x, dz};
+    cubes.push_back(c);
+    ++patterns.back().numCubes;
+  }
+  void end(const float depth) {
+    patterns.back().depth = depth;
+  }
+
+  // a row across the field at dz, open around gapX (no gap if gapX < 0)
+  void row(const float dz, const float gapX) {
+    for (float x = g_wallSpacing / 2; x < 1; x += g_wallSpacing) {
+      if (gapX < 0 || fabs(x - gapX) > g_gapHalfWidth) {
+        add(x, dz);
+      }
+    }
+  }
+};
+
+void writeDefaultPatternLibrary(const char* filename) {
+  PatternBuilder b;
+
+  // walls with a gap to steer through
+  const float gaps[] = {.2f, .5f, .8f};
+  for (int i = 0; i < 3; ++i) {
+    b.begin();
+    b.row(0, gaps[i]);
+    b.end(2);
+  }
+  // two walls whose gaps are on opposite sides
+  b.begin();
+  b.row(0, .25f);
+  b.row(1.2f, .75f);
+  b.end(3);
+
+  // corridors: a lane walled in on both sides
+  const float lanes[] = {.3f, .5f, .7f};
+  for (int i = 0; i < 3; ++i) {
+    b.begin();
+    for (float dz = 0; dz < 2; dz += .3f) {
+      b.add(lanes[i] - 1.5f * g_gapHalfWidth, dz);
+      b.add(lanes[i] + 1.5f * g_gapHalfWidth, dz);
+    }
+    b.end(2.8f);
+  }
+
+  // rows with no gap, to jump
+  b.begin();
+  b.row(0, -1);
+  b.end(2);
+  b.begin();
+  b.row(0, -1);
+  b.row(1.6f, -1);
+  b.end(3.5f);
+
+  PatternHeader header;
+  memcpy(header.magic, g_patternMagic, sizeof(g_patternMagic));
+  header.version = g_patternVersion;
+  header.numPatterns = (unsigned)b.patterns.size();
+  header.numCubes = (unsigned)b.cubes.size();
+
+  ofstream f(filename, ios::binary);
+  if (!f)
+    throw runtime_error(string("writeDefaultPatternLibrary: cannot open ") + filename);
+  f.write((const char*)&header, sizeof(header));
+  f.write((const char*)&b.patterns[0], b.patterns.size() * sizeof(PatternInfo));
+  f.write((const char*)&b.cubes[0], b.cubes.size() * sizeof(PatternCube));
+  if (!f)
+    throw runtime_error(string("writeDefaultPatternLibrary: cannot write ") + filename);
+}
@@ -0,0 +1,66 @@
+#ifndef PATTERNS_H
+#define PATTERNS_H
+
+#include <cstddef>
+
+// Library of designed cube formations (walls with gaps, corridors, rows to
+// jump) that GameWorld splices into the field a chunk at a time.
+//
+// The file is memory-mapped and used in place. Its 4-byte fields are in
+// the byte order of the machine that wrote it, so the tables can be read
+// straight from the mapping, and a library written on a machine of the
+// other byte order is rejected:
+//   header   "CRPL", version (4 bytes), pattern count, cube count
+//   patterns one PatternInfo per pattern
+//   cubes    one PatternCube per cube, each pattern's cubes contiguous
+// Loading only checks the header against the file size, so it takes the
+// same few microseconds for any size of library. Entries are checked when
+// they are read instead: a pattern pointing outside the cube table has no
+// cubes, a chunk's depth is clamped to the length of the field, and a cube's
+// x and dz are clamped into range, NaN included, so no file can put a cube
+// where the field's grids can't index it.
+
+// One cube of a pattern
+struct PatternCube {
+  float x;  // across the field, 0 at its left side and 1 at its right
+  float dz; // distance beyond the near edge of the pattern's chunk, in [0, depth]
+};
+
+struct PatternInfo {
+  unsigned firstCube;
+  unsigned numCubes;
+  float depth; // length of the chunk along z, including the space after the cubes
+};
+
+class PatternLibrary {
+public:
+  // maps filename; throws on a missing or malformed file
+  explicit PatternLibrary(const char* filename);
+  ~PatternLibrary();
+
+  int size() const { return (int)numPatterns_; }
+  float depth(int pattern) const;
+  int numCubes(int pattern) const;
+  // cube i of the pattern's numCubes(), clamped into range
+  PatternCube cube(int pattern, int i) const;
+
+private:
+  PatternLibrary(const PatternLibrary&);
+  PatternLibrary& operator=(const PatternLibrary&);
+  void unmap();
+
+  const unsigned char* data_;
+  size_t size_;
+#ifdef _WIN32
+  void* file_;
+  void* mapping_;
+#endif
+  unsigned numPatterns_, numCubes_;
+  const PatternInfo* patterns_;
+  const PatternCube* cubes_;
+};
+
+// writes the built-in walls, corridors and jump rows as a library; throws on error
+void writeDefaultPatternLibrary(const char* filename);
+
+#endif
@@ -0,0 +1,153 @@
+#include <cmath>
+#include <algorithm>
+
+#include "planner.h"
+#include "gameclock.h"
+
+using namespace std;
+
+static const float g_clearanceCap = 3;   // clearance beyond this doesn't make a plan better
+static const float g_actionCost = .05f;  // clearance a swerve or jump is worth giving up
+
+Planner::Planner(const Options& options)
+  : options_(options), pool_(options.threads), truncatedPlans_(0)
+{
+  beam_.reserve(options_.beamWidth);
+  children_.reserve(options_.beamWidth * NUM_ACTIONS);
+  slots_.resize(options_.beamWidth * NUM_ACTIONS);
+}
+
+GameInput Planner::actionInput(const int action) {
+  GameInput input;
+  input.left = action == ACTION_LEFT;
+  input.right = action == ACTION_RIGHT;
+  input.jump = action == ACTION_JUMP;
+  return input;
+}
+
+// scores a plan that survived to tick
+void Planner::rank(const GameWorld& world, Node& node, const int tick) {
+  node.score = world.clearanceAhead(node.player.pose, scrolls_[tick], g_clearanceCap) - g_actionCost * node.cost;
+}
+
+// a survives longer than b, or as long with a better score
+bool Planner::better(const Node& a, const Node& b) {
+  return a.survived > b.survived || (a.survived == b.survived && a.score > b.score);
+}
+
+bool Planner::samePlayer(const Node& a, const Node& b) {
+  return a.player.pose.x == b.player.pose.x && a.player.pose.tilt == b.player.pose.tilt &&
+         a.player.pose.height == b.player.pose.height &&
+         a.player.jumpInProgress == b.player.jumpInProgress && a.player.jumpPeakReached == b.player.jumpPeakReached;
+}
+
+// fills the slots of beam_[parent] with its children for one more action each
+void Planner::expand(const GameWorld& world, const int parent, const int level, const int actionTicks) {
+  for (int action = 0; action < NUM_ACTIONS; ++action) {
+    Node& child = slots_[parent * NUM_ACTIONS + action];
+    if (action == ACTION_JUMP && beam_[parent].player.jumpInProgress) {
+      child.survived = -1;
+      continue;
+    }
+    child = beam_[parent];
+    if (level == 0) {
+      child.firstAction = action;
+    }
+    if (action != ACTION_STRAIGHT) {
+      ++child.cost;
+    }
+
+    // a jump is pressed once, the other actions are held
+    GameInput input = actionInput(action);
+    const int first = level * actionTicks;
+    child.survived = first + actionTicks;
+    for (int k = first; k < first + actionTicks; ++k) {
+      const PlayerPose from = child.player.pose;
+      world.movePlayer(child.player, input);
+      input.jump = false;
+      if (world.runnerHits(from, scrolls_[k], child.player.pose, scrolls_[k + 1])) {
+        child.survived = k;
+        child.score = -g_actionCost * child.cost;
+        break;
+      }
+    }
+    if (child.survived == first + actionTicks) {
+      rank(world, child, child.survived);
+    }
+  }
+}
+
+GameInput Planner::plan(const GameWorld& world, const float scrollFrom) {
+  const double begin = options_.timeBudget > 0 ? getMonotonicSeconds() : 0;
+
+  // action lengths and the horizon are in time, so plans reach as far at any tick rate
+  const float ticksPerDefaultTick = (float)world.getSimulationsPerSecond() / g_simulationsPerSecond;
+  const int actionTicks = max(1, (int)floor(options_.actionTicks * ticksPerDefaultTick + .5f));
+  const int horizonTicks = max(1, (int)ceil(options_.horizonSeconds * world.getSimulationsPerSecond()));
+  const int levels = (horizonTicks + actionTicks - 1) / actionTicks;
+
+  // the scroll of every tick ahead, which all plans share
+  const int ticks = levels * actionTicks;
+  scrolls_.resize(ticks + 1);
+  scrolls_[0] = scrollFrom;
+  for (int k = 1; k <= ticks; ++k) {
+    scrolls_[k] = world.predictScroll(k - 1);
+  }
+
+  Node root;
+  root.player = world.getPlayer();
+  root.firstAction = ACTION_STRAIGHT;
+  root.cost = 0;
+  root.survived = 0;
+  root.score = 0;
+  beam_.assign(1, root);
+
+  Node best = root; // best plan that crashed
+  best.survived = -1;
+
+  for (int level = 0; level < levels; ++level) {
+    auto expandItem = [this, &world, level, actionTicks](int parent, int) {
+      expand(world, parent, level, actionTicks);
+    };
+    pool_.run((int)beam_.size(), expandItem);
+
+    // in slot order, whichever thread filled them
+    children_.clear();
+    const int alive = (level + 1) * actionTicks;
+    for (size_t i = 0; i < beam_.size() * NUM_ACTIONS; ++i) {
+      const Node& child = slots_[i];
+      if (child.survived == alive) {
+        children_.push_back(child);
+      }
+      else if (child.survived >= 0 && better(child, best)) {
+        best = child;
+      }
+    }
+    if (children_.empty())
+      break;
+
+    // the best distinct plans go on; equal players are equal from here on
+    stable_sort(children_.begin(), children_.end(), better);
+    beam_.clear();
+    for (size_t i = 0; i < children_.size() && (int)beam_.size() < options_.beamWidth; ++i) {
+      bool seen = false;
+      for (size_t j = 0; j < beam_.size() && !seen; ++j) {
+        seen = samePlayer(children_[i], beam_[j]);
+      }
+      if (!seen) {
+        beam_.push_back(children_[i]);
+      }
+    }
+
+    if (options_.timeBudget > 0 && level + 1 < levels && getMonotonicSeconds() - begin > options_.timeBudget) {
+      ++truncatedPlans_;
+      break;
+    }
+  }
+
+  // beam_ holds the best plans still alive, unless every plan crashed
+  if (!children_.empty() && better(beam_[0], best)) {
+    best = beam_[0];
+  }
+  return actionInput(best.firstAction);
+}
@@ -0,0 +1,81 @@
+#ifndef PLANNER_H
+#define PLANNER_H
+
+#include <vector>
+
+#include "gameworld.h"
+#include "workpool.h"
+
+static const float g_maxPlannerHorizon = 10; // seconds, bounds the search's memory at high tick rates
+
+// Autonomous player that looks ahead instead of reacting to nearby cubes.
+//
+// Each tick it runs a beam search over short sequences of actions (straight,
+// left, right, jump), each held for a few ticks. Only the player is cloned
+// and moved (a PlayerState is a few floats); the cubes are left in the world
+// and queried with GameWorld::runnerHits() at the scroll the tick would have,
+// so a plan costs no copying of the field. Cubes that spawn during the
+// horizon are not foreseen, which only matters at its far end.
+//
+// Plans are ranked by how many ticks they survive, then by the clearance
+// left ahead of the runner at their end, with a small cost for every swerve
+// and jump. The first action of the best plan is played, and the search runs
+// again on the next tick.
+//
+// Each level of the search expands its plans on a WorkPool. A plan's children
+// go to slots of their own, set aside for it before the search starts, so the
+// threads share nothing they write and never allocate; the slots are then
+// read in order on the calling thread, which makes the plan the same for any
+// number of threads. More threads buy a wider beam or a longer horizon, not a
+// different answer.
+//
+// The search stops early when it has used its time budget, keeping the best
+// plan found so far; with a budget of 0 it always searches the whole horizon
+// and, like the rest of the world, gives the same game for the same seed.
+class Planner {
+public:
+  struct Options {
+    float horizonSeconds; // how far ahead plans reach
+    int actionTicks;      // default ticks each action of a plan is held for
+    int beamWidth;        // plans kept from one action to the next
+    double timeBudget;    // seconds a plan() may take, 0 for no limit
+    int threads;          // threads the search runs on, counting the caller
+
+    Options() : horizonSeconds(1.2f), actionTicks(3), beamWidth(24), timeBudget(0), threads(1) {}
+  };
+
+  explicit Planner(const Options& options = Options());
+
+  // the input for the tick world is stepping, which started at scroll
+  // scrollFrom; called by GameWorld::step()
+  GameInput plan(const GameWorld& world, float scrollFrom);
+
+  // searches cut short by the time budget, since construction
+  long long getTruncatedPlans() const { return truncatedPlans_; }
+
+private:
+  enum Action { ACTION_STRAIGHT, ACTION_LEFT, ACTION_RIGHT, ACTION_JUMP, NUM_ACTIONS };
+
+  struct Node {
+    PlayerState player;
+    int firstAction;
+    int cost;      // swerves and jumps so far
+    int survived;  // ticks survived, less than the ticks searched if it crashed; -1 for no plan
+    float score;   // ranks plans that survived equally long
+  };
+
+  static GameInput actionInput(int action);
+  void expand(const GameWorld& world, int parent, int level, int actionTicks);
+  void rank(const GameWorld& world, Node& node, int tick);
+  static bool better(const Node& a, const Node& b);
+  static bool samePlayer(const Node& a, const Node& b);
+
+  Options options_;
+  std::vector<float> scrolls_; // scroll at the start of each tick of the horizon
+  std::vector<Node> beam_, children_;
+  std::vector<Node> slots_;    // NUM_ACTIONS children for every plan of the beam
+  WorkPool pool_;
+  long long truncatedPlans_;
+};
+
+#endif
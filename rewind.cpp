@@ -0,0 +1,115 @@
+#include <stdexcept>
+
+#include "rewind.h"
+#include "inputlog.h"
+
+using namespace std;
+
+RewindBuffer::RewindBuffer(const int keyframeInterval, const int maxKeyframes)
+  : keyframeInterval_(keyframeInterval), keyframes_(maxKeyframes),
+    firstKeyframe_(0), numKeyframes_(0), recordBase_(0), cursor_(0), lastTick_(0)
+{
+  if (keyframeInterval <= 0 || maxKeyframes <= 0)
+    throw runtime_error("RewindBuffer: the keyframe interval and count must be positive");
+}
+
+void RewindBuffer::restart(const GameWorld& world) {
+  firstKeyframe_ = 0;
+  numKeyframes_ = 0;
+  records_.clear();
+  recordBase_ = 0;
+  cursor_ = 0;
+  lastTick_ = world.getTicks();
+  addKeyframe(world);
+}
+
+// saves the world at the cursor, dropping the oldest keyframe if the ring is full
+void RewindBuffer::addKeyframe(const GameWorld& world) {
+  if (numKeyframes_ == (int)keyframes_.size()) {
+    firstKeyframe_ = (firstKeyframe_ + 1) % keyframes_.size();
+    --numKeyframes_;
+    // nothing before the new oldest keyframe can be replayed any more
+    const size_t first = numKeyframes_ > 0 ? keyframe(0).record : cursor_;
+    records_.erase(records_.begin(), records_.begin() + (first - recordBase_));
+    recordBase_ = first;
+  }
+  Keyframe& k = keyframe(numKeyframes_++);
+  k.tick = world.getTicks();
+  k.record = cursor_;
+  world.saveSnapshot(k.snapshot);
+}
+
+// forgets everything recorded after the world's current state
+void RewindBuffer::dropFuture(const GameWorld& world) {
+  if (cursor_ == recordBase_ + records_.size())
+    return;
+  records_.resize(cursor_ - recordBase_);
+  while (numKeyframes_ > 1 && keyframe(numKeyframes_ - 1).record > cursor_) {
+    --numKeyframes_;
+  }
+  lastTick_ = world.getTicks();
+}
+
+unsigned RewindBuffer::step(GameWorld& world, const GameInput& input) {
+  dropFuture(world);
+  records_.push_back(packTickInput(input));
+  ++cursor_;
+  const unsigned events = world.step(input);
+  lastTick_ = world.getTicks();
+  if (lastTick_ % keyframeInterval_ == 0) {
+    addKeyframe(world);
+  }
+  return events;
+}
+
+bool RewindBuffer::applyCommand(GameWorld& world, const GameCommand command, const float value) {
+  dropFuture(world);
+  unsigned char record[g_commandRecordSize];
+  packCommand(command, value, record);
+  records_.insert(records_.end(), record, record + g_commandRecordSize);
+  cursor_ += g_commandRecordSize;
+  return world.applyCommand(command, value);
+}
+
+long long RewindBuffer::firstTick() const {
+  return keyframe(0).tick;
+}
+
+long long RewindBuffer::lastTick() const {
+  return lastTick_;
+}
+
+void RewindBuffer::seek(GameWorld& world, long long tick) {
+  tick = max(firstTick(), min(tick, lastTick()));
+  if (tick < world.getTicks()) {
+    // restore the last keyframe at or before tick
+    int i = numKeyframes_ - 1;
+    while (i > 0 && keyframe(i).tick > tick) {
+      --i;
+    }
+    const Keyframe& k = keyframe(i);
+    world.restoreSnapshot(k.snapshot);
+    cursor_ = k.record;
+  }
+  replayTo(world, tick);
+}
+
+// replays records from the cursor up to the next tick after the given one
+void RewindBuffer::replayTo(GameWorld& world, const long long tick) {
+  const size_t end = recordBase_ + records_.size();
+  while (cursor_ < end) {
+    const unsigned char record = records_[cursor_ - recordBase_];
+    if (isCommandRecord(record)) {
+      float value;
+      const GameCommand command = unpackCommand(&records_[cursor_ - recordBase_], value);
+      world.applyCommand(command, value);
+      cursor_ += g_commandRecordSize;
+    }
+    else {
+      if (world.getTicks() >= tick)
+        break;
+      world.step(unpackTickInput(record));
+      ++cursor_;
+    }
+  }
+}
@@ -0,0 +1,63 @@
+#ifndef REWIND_H
+#define REWIND_H
+
+#include <vector>
+
+#include "gameworld.h"
+
+// History of a game that lets it be rewound to any recent tick exactly.
+//
+// Every keyframeInterval ticks the world is saved into a ring of snapshots.
+// Between keyframes only the inputs and commands are kept, a byte per tick and
+// five per command in the format of inputlog.h, since the world replays them
+// deterministically. A tick is rebuilt by restoring the last keyframe at or
+// before it and stepping through the recorded inputs, so no seek re-simulates
+// more than keyframeInterval ticks. When the ring is full the oldest keyframe
+// and its inputs are dropped, which bounds the memory used.
+//
+// The world must only be stepped and commanded through the buffer once
+// restart() has been called on it.
+class RewindBuffer {
+public:
+  RewindBuffer(int keyframeInterval, int maxKeyframes);
+
+  // forgets the history and starts a new one at the world's current state
+  void restart(const GameWorld& world);
+
+  // GameWorld::step() and applyCommand(), recorded. After a seek back
+  // the recorded future is dropped first, so the game branches from there.
+  unsigned step(GameWorld& world, const GameInput& input);
+  bool applyCommand(GameWorld& world, GameCommand command, float value = 0);
+
+  long long firstTick() const; // oldest tick that can be returned to
+  long long lastTick() const;  // newest tick recorded
+
+  // puts the world in its state just after the given tick was stepped and the
+  // commands that followed it were applied. tick is clamped to
+  // [firstTick(), lastTick()].
+  void seek(GameWorld& world, long long tick);
+
+private:
+  struct Keyframe {
+    long long tick;
+    size_t record;          // index of the first record after the snapshot
+    WorldSnapshot snapshot;
+  };
+
+  Keyframe& keyframe(int i) { return keyframes_[(firstKeyframe_ + i) % keyframes_.size()]; }
+  const Keyframe& keyframe(int i) const { return keyframes_[(firstKeyframe_ + i) % keyframes_.size()]; }
+  void addKeyframe(const GameWorld& world);
+  void dropFuture(const GameWorld& world);
+  void replayTo(GameWorld& world, long long tick);
+
+  int keyframeInterval_;
+  std::vector<Keyframe> keyframes_; // ring, slots are reused so snapshots keep their storage
+  int firstKeyframe_;
+  int numKeyframes_;
+  std::vector<unsigned char> records_;
+  size_t recordBase_; // index of records_[0] in the whole history
+  size_t cursor_;     // index of the next record to replay, the end unless the world was rewound
+  long long lastTick_;
+};
+
+#endif
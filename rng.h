@@ -0,0 +1,59 @@
+#ifndef RNG_H
+#define RNG_H
+
+// Small, fast pseudo-random generator (xoshiro128**). Each GameWorld owns
+// one, so a game is reproducible from its seed and several worlds can run at
+// once without sharing the libc rand() state.
+class Rng {
+public:
+  explicit Rng(const unsigned long long seed = 0) {
+    setSeed(seed);
+  }
+
+  // the four state words are filled from the seed with splitmix64, so that
+  // nearby seeds still give unrelated streams
+  void setSeed(unsigned long long seed) {
+    for (int i = 0; i < 4; i += 2) {
+      seed += 0x9e3779b97f4a7c15ULL;
+      unsigned long long z = seed;
+      z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+      z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+      z ^= z >> 31;
+      s_[i] = (unsigned)z;
+      s_[i + 1] = (unsigned)(z >> 32);
+    }
+  }
+
+  // uniformly distributed 32 bits
+  unsigned next() {
+    const unsigned result = rotl(s_[1] * 5, 7) * 9;
+    const unsigned t = s_[1] << 9;
+    s_[2] ^= s_[0];
+    s_[3] ^= s_[1];
+    s_[1] ^= s_[2];
+    s_[0] ^= s_[3];
+    s_[2] ^= t;
+    s_[3] = rotl(s_[3], 11);
+    return result;
+  }
+
+  // uniform in [0, 1), 24 bits of precision
+  float nextFloat() {
+    return (next() >> 8) * (1.0f / 16777216.0f);
+  }
+
+  // same state, so the same numbers from here on
+  bool operator==(const Rng& other) const {
+    return s_[0] == other.s_[0] && s_[1] == other.s_[1] && s_[2] == other.s_[2] && s_[3] == other.s_[3];
+  }
+  bool operator!=(const Rng& other) const { return !(*this == other); }
+
+private:
+  static unsigned rotl(const unsigned x, const int k) {
+    return (x << k) | (x >> (32 - k));
+  }
+
+  unsigned s_[4];
+};
+
+#endif
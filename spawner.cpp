@@ -0,0 +1,132 @@
+#include "spawner.h"
+#include "cubestore.h"
+#include "gameworld.h"
+
+using namespace std;
+
+SpawnRecord drawSpawn(Rng& rng, const int colors) {
+  SpawnRecord r;
+  r.before = rng;
+  r.colors = colors;
+  r.x = rng.nextFloat();
+  const float z = rng.nextFloat();
+  r.z = g_furthestCubeZ + g_zRange*z;
+
+  Cvec3f color;
+  if (colors <= SPAWN_COLORS_BLUE) {
+    // RED-GREEN-BLUE LEVELS MODE
+    float c = rng.nextFloat();
+    c = (.9 * c) + .1;
+    if (colors == SPAWN_COLORS_RED) {
+      color = Cvec3f(c,0,0);
+    }
+    else if (colors == SPAWN_COLORS_GREEN) {
+      color = Cvec3f(0,c,0);
+    }
+    else {
+      color = Cvec3f(0,0,c);
+    }
+  }
+  else if (colors == SPAWN_COLORS_DEATH) {
+    color = Cvec3f(.1,.1,.1);
+  }
+  else {
+    // RANDOM COLORS MODE
+    float red = rng.nextFloat();
+    float green = rng.nextFloat();
+    float blue = rng.nextFloat();
+    color = Cvec3f(red,green,blue);
+  }
+  r.color = packColor(color);
+  r.after = rng;
+  r.serial = 0;
+  return r;
+}
+
+SpawnPregenerator::SpawnPregenerator(const size_t capacity)
+  : ring_(capacity), stopping_(false), sleeping_(false), serial_(0)
+{
+  thread_ = thread(&SpawnPregenerator::run, this);
+}
+
+SpawnPregenerator::~SpawnPregenerator() {
+  stopping_ = true;
+  wake();
+  thread_.join();
+}
+
+SpawnRecord SpawnPregenerator::take(Rng& rng, const int colors) {
+  SpawnRecord r;
+  while (ring_.pop(r)) {
+    if (r.serial != serial_)
+      continue; // drawn before the last restart
+    if (r.colors == colors && r.before == rng) {
+      rng = r.after;
+      wake(); // there is room in the ring again
+      return r;
+    }
+    break;
+  }
+  // no usable record: draw it here and have the thread follow on from here
+  r = drawSpawn(rng, colors);
+  restart(rng, colors);
+  return r;
+}
+
+void SpawnPregenerator::restart(const Rng& rng, const int colors) {
+  Restart& request = requests_.back();
+  request.rng = rng;
+  request.colors = colors;
+  request.serial = ++serial_;
+  requests_.publish();
+  wake();
+}
+
+// called by the world's thread after it made room in the ring or published a
+// restart. The fence orders that before the check of sleeping_, as the one in
+// run() orders setting sleeping_ before the thread's last look at the ring and
+// the requests, so either this sees the thread asleep or the thread sees the
+// change.
+void SpawnPregenerator::wake() {
+  atomic_thread_fence(memory_order_seq_cst);
+  if (sleeping_.load(memory_order_relaxed)) {
+    lock_guard<mutex> lock(mutex_);
+    wakeup_.notify_one();
+  }
+}
+
+// background thread: keeps the ring full from the latest requested state
+void SpawnPregenerator::run() {
+  unsigned serial = 0;
+  Rng rng;
+  int colors = SPAWN_COLORS_RANDOM;
+  SpawnRecord next;
+  bool pending = false; // next is drawn but the ring was full
+  while (!stopping_) {
+    const Restart& request = requests_.newest();
+    if (request.serial != serial) {
+      serial = request.serial;
+      rng = request.rng;
+      colors = request.colors;
+      pending = false;
+    }
+    if (serial != 0 && !pending) {
+      next = drawSpawn(rng, colors);
+      next.serial = serial;
+      pending = true;
+    }
+    if (serial != 0 && ring_.push(next)) {
+      pending = false;
+      continue;
+    }
+
+    // nothing to do until take() makes room or asks for a restart
+    unique_lock<mutex> lock(mutex_);
+    sleeping_.store(true, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    while (!stopping_ && requests_.newest().serial == serial && (serial == 0 || ring_.full())) {
+      wakeup_.wait(lock);
+    }
+    sleeping_.store(false, memory_order_relaxed);
+  }
+}
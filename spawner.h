@@ -0,0 +1,85 @@
+#ifndef SPAWNER_H
+#define SPAWNER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "rng.h"
+#include "spscring.h"
+#include "triplebuffer.h"
+
+// How a spawned cube is colored, which decides what it draws from the
+// world's random stream
+enum SpawnColors {
+  SPAWN_COLORS_RED,    // RGB mode, by color level
+  SPAWN_COLORS_GREEN,
+  SPAWN_COLORS_BLUE,
+  SPAWN_COLORS_DEATH,  // all dark
+  SPAWN_COLORS_RANDOM  // tutorial
+};
+
+// The random part of one cube: everything GameWorld::addCube() draws from the
+// stream, and the stream's state before and after
+struct SpawnRecord {
+  float x;        // in [0, 1), across the field
+  float z;        // current z
+  unsigned color; // packed RGBA8
+  int colors;     // SpawnColors it was drawn for
+  Rng before, after;
+  unsigned serial; // SpawnPregenerator restart it was drawn under
+};
+
+// draws the next cube from rng
+SpawnRecord drawSpawn(Rng& rng, int colors);
+
+// Draws cubes ahead of time on a background thread and hands them to one
+// world through a wait-free SpscRing, so a tick only copies a finished record.
+//
+// The thread draws from its own copy of the world's generator. A record is
+// only used if it was drawn from exactly the world's current generator state
+// for the current colors, so the world gets the same cubes with or without a
+// pregenerator. When they differ (the colors changed, the world was reset or
+// rewound, or the thread fell behind) the world draws the cube itself and
+// asks the thread to start over from its new state; records drawn before the
+// restart are dropped.
+//
+// The thread sleeps while it has nothing to do, before the first restart and
+// while the ring is full, and take() wakes it. take() only takes the lock when
+// the thread is asleep, so while it is drawing take() still never waits.
+class SpawnPregenerator {
+public:
+  explicit SpawnPregenerator(size_t capacity = 256);
+  ~SpawnPregenerator();
+
+  // called by the world's thread: draws the next cube from rng for colors,
+  // using a pregenerated one if it matches
+  SpawnRecord take(Rng& rng, int colors);
+
+private:
+  void run();
+  void restart(const Rng& rng, int colors);
+  void wake();
+
+  SpscRing<SpawnRecord> ring_;
+  std::thread thread_;
+  std::atomic<bool> stopping_;
+  std::atomic<bool> sleeping_; // the thread is waiting on wakeup_, or about to
+  std::mutex mutex_;
+  std::condition_variable wakeup_;
+
+  // restart requests, handed from the world's thread to the background one
+  // through a TripleBuffer so that take() never waits
+  struct Restart {
+    Rng rng;
+    int colors;
+    unsigned serial; // 0 until the first restart
+
+    Restart() : colors(SPAWN_COLORS_RANDOM), serial(0) {}
+  };
+  TripleBuffer<Restart> requests_;
+  unsigned serial_; // serial of the last restart, owned by the world's thread
+};
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef SPSCRING_H
+#define SPSCRING_H
+
+#include <atomic>
+#include <vector>
+
+// Bounded queue between exactly one producer thread and one consumer thread.
+// push() and pop() never wait and never take a lock: each side only writes
+// its own index, and reads the other's with acquire ordering, so an element is
+// fully written before the consumer can see it. The indices sit on separate
+// cache lines so the two sides don't contend for one.
+template <class T>
+class SpscRing {
+public:
+  // capacity is rounded up to a power of two
+  explicit SpscRing(size_t capacity) : head_(0), tail_(0) {
+    size_t n = 1;
+    while (n < capacity) {
+      n <<= 1;
+    }
+    slots_.resize(n);
+    mask_ = n - 1;
+  }
+
+  // producer: returns false if the ring is full
+  bool push(const T& value) {
+    const size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail - head_.load(std::memory_order_acquire) > mask_)
+      return false;
+    slots_[tail & mask_] = value;
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // producer: true if push() would return false
+  bool full() const {
+    return tail_.load(std::memory_order_relaxed) - head_.load(std::memory_order_acquire) > mask_;
+  }
+
+  // consumer: returns false if the ring is empty
+  bool pop(T& value) {
+    const size_t head = head_.load(std::memory_order_relaxed);
+    if (head == tail_.load(std::memory_order_acquire))
+      return false;
+    value = slots_[head & mask_];
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+private:
+  std::vector<T> slots_;
+  size_t mask_;
+  // padded rather than aligned, so the indices get lines of their own however
+  // the ring itself is allocated
+  char pad0_[64];
+  std::atomic<size_t> head_; // next slot to pop, written by the consumer
+  char pad1_[64 - sizeof(std::atomic<size_t>)];
+  std::atomic<size_t> tail_; // next slot to push, written by the producer
+  char pad2_[64 - sizeof(std::atomic<size_t>)];
+};
+
+#endif
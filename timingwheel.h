@@ -0,0 +1,168 @@
+#ifndef TIMINGWHEEL_H
+#define TIMINGWHEEL_H
+
+#include <vector>
+#include <climits>
+
+// Hierarchical timing wheel of small integer events keyed by absolute tick.
+//
+// Level 0 has a slot for each of the 64 ticks of the current 64-tick block,
+// level 1 a slot for each 64-tick block of the current 4096-tick block, and
+// so on. An event is stored at the lowest level whose block it shares with
+// the current tick, so inserting is O(1), and as time enters a new block the
+// events of that block's slot move down a level. Events further out than the
+// top level wait in an overflow list. A bit per slot lets nextTick() find the
+// next event without visiting empty slots, which lets callers jump over idle
+// spans.
+class TimingWheel {
+public:
+  static const int SLOT_BITS = 6;
+  static const int NUM_SLOTS = 1 << SLOT_BITS;
+  static const int NUM_LEVELS = 4;
+  static const long long NEVER = LLONG_MAX;
+
+  struct Entry {
+    long long tick;
+    int event;
+  };
+
+  TimingWheel() : now_(0), count_(0) {
+    clear(0);
+  }
+
+  // drops every event and sets the current tick
+  void clear(const long long now) {
+    for (int level = 0; level < NUM_LEVELS; ++level) {
+      for (int slot = 0; slot < NUM_SLOTS; ++slot) {
+        slots_[level][slot].clear();
+      }
+      occupied_[level] = 0;
+    }
+    overflow_.clear();
+    now_ = now;
+    count_ = 0;
+  }
+
+  long long now() const { return now_; }
+  bool empty() const { return count_ == 0; }
+
+  // schedules event at tick, which must be after the current tick
+  void schedule(const long long tick, const int event) {
+    Entry e = {tick, event};
+    insert(e);
+    ++count_;
+  }
+
+  // Moves the current tick forward to tick and appends the events due at it
+  // to due. No event may be scheduled between the current tick and tick,
+  // i.e. tick must not be past nextTick().
+  void advance(const long long tick, std::vector<int>& due) {
+    const long long before = now_;
+    now_ = tick;
+    // entering a new block at some level brings that block's events down
+    if ((before >> (SLOT_BITS * NUM_LEVELS)) != (now_ >> (SLOT_BITS * NUM_LEVELS))) {
+      std::vector<Entry> far;
+      far.swap(overflow_);
+      for (size_t i = 0; i < far.size(); ++i) {
+        insert(far[i]);
+      }
+    }
+    for (int level = NUM_LEVELS - 1; level > 0; --level) {
+      if ((before >> (SLOT_BITS * level)) != (now_ >> (SLOT_BITS * level))) {
+        cascade(level);
+      }
+    }
+
+    const int slot = (int)(now_ & (NUM_SLOTS - 1));
+    std::vector<Entry>& entries = slots_[0][slot];
+    for (size_t i = 0; i < entries.size(); ++i) {
+      due.push_back(entries[i].event);
+    }
+    count_ -= (int)entries.size();
+    entries.clear();
+    occupied_[0] &= ~(1ULL << slot);
+  }
+
+  // the earliest tick with an event, NEVER if there is none
+  long long nextTick() const {
+    for (int level = 0; level < NUM_LEVELS; ++level) {
+      const int current = (int)((now_ >> (SLOT_BITS * level)) & (NUM_SLOTS - 1));
+      const unsigned long long ahead = occupied_[level] & (~0ULL << current);
+      if (ahead == 0)
+        continue;
+      // events at a level all come before those of the levels above it
+      const std::vector<Entry>& entries = slots_[level][lowestBit(ahead)];
+      long long earliest = NEVER;
+      for (size_t i = 0; i < entries.size(); ++i) {
+        if (entries[i].tick < earliest) {
+          earliest = entries[i].tick;
+        }
+      }
+      return earliest;
+    }
+    long long earliest = NEVER;
+    for (size_t i = 0; i < overflow_.size(); ++i) {
+      if (overflow_[i].tick < earliest) {
+        earliest = overflow_[i].tick;
+      }
+    }
+    return earliest;
+  }
+
+  // appends every scheduled event to out, in no particular order
+  void pending(std::vector<Entry>& out) const {
+    for (int level = 0; level < NUM_LEVELS; ++level) {
+      for (int slot = 0; slot < NUM_SLOTS; ++slot) {
+        out.insert(out.end(), slots_[level][slot].begin(), slots_[level][slot].end());
+      }
+    }
+    out.insert(out.end(), overflow_.begin(), overflow_.end());
+  }
+
+private:
+  static int lowestBit(const unsigned long long bits) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctzll(bits);
+#else
+    int bit = 0;
+    while (!((bits >> bit) & 1)) {
+      ++bit;
+    }
+    return bit;
+#endif
+  }
+
+  void insert(const Entry& e) {
+    for (int level = 0; level < NUM_LEVELS; ++level) {
+      if ((e.tick >> (SLOT_BITS * (level + 1))) == (now_ >> (SLOT_BITS * (level + 1)))) {
+        const int slot = (int)((e.tick >> (SLOT_BITS * level)) & (NUM_SLOTS - 1));
+        slots_[level][slot].push_back(e);
+        occupied_[level] |= 1ULL << slot;
+        return;
+      }
+    }
+    overflow_.push_back(e);
+  }
+
+  // moves the events of the current slot of level down to the levels below
+  void cascade(const int level) {
+    const int slot = (int)((now_ >> (SLOT_BITS * level)) & (NUM_SLOTS - 1));
+    std::vector<Entry> entries;
+    entries.swap(slots_[level][slot]);
+    occupied_[level] &= ~(1ULL << slot);
+    for (size_t i = 0; i < entries.size(); ++i) {
+      insert(entries[i]);
+    }
+    // hand the storage back so the slot doesn't allocate next time round
+    entries.clear();
+    slots_[level][slot].swap(entries);
+  }
+
+  long long now_;
+  int count_;
+  std::vector<Entry> slots_[NUM_LEVELS][NUM_SLOTS];
+  unsigned long long occupied_[NUM_LEVELS]; // bit per non-empty slot
+  std::vector<Entry> overflow_;
+};
+
+#endif
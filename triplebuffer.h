@@ -0,0 +1,44 @@
+#ifndef TRIPLEBUFFER_H
+#define TRIPLEBUFFER_H
+
+#include <atomic>
+
+// Hands the newest of a stream of values from one producer thread to one
+// consumer thread without locks. The producer fills back() and publish()es
+// it; the consumer takes the newest published value with newest(). Each side
+// owns one of the three buffers and the third is swapped between them with a
+// single atomic exchange, so neither side ever waits for the other or sees a
+// value that is still being written. Values the consumer was too slow to see
+// are skipped, and the buffers are reused, so T's storage is kept.
+template <class T>
+class TripleBuffer {
+public:
+  TripleBuffer() : back_(0), front_(1), middle_(2) {}
+
+  // producer: the value being filled
+  T& back() { return buffers_[back_]; }
+
+  // producer: makes back() the newest value and starts filling another
+  void publish() {
+    back_ = middle_.exchange(back_ | FRESH, std::memory_order_acq_rel) & INDEX;
+  }
+
+  // consumer: the newest published value, which stays valid and unchanged
+  // until the next call
+  const T& newest() {
+    if (middle_.load(std::memory_order_relaxed) & FRESH) {
+      front_ = middle_.exchange(front_, std::memory_order_acq_rel) & INDEX;
+    }
+    return buffers_[front_];
+  }
+
+private:
+  enum { INDEX = 3, FRESH = 4 }; // middle_ holds a buffer index and whether it was published since last taken
+
+  T buffers_[3];
+  int back_;                // owned by the producer
+  int front_;               // owned by the consumer
+  std::atomic<int> middle_;
+};
+
+#endif
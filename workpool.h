@@ -0,0 +1,143 @@
+#ifndef WORKPOOL_H
+#define WORKPOOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Runs the items of a loop on a fixed set of threads, the caller among them.
+//
+// run(n, fn) splits the items 0 to n-1 into one contiguous share per thread.
+// Each thread takes items from the front of its own share with an atomic
+// increment and, once it is empty, steals from the front of the other shares
+// the same way, so the threads that drew quick items help the ones that drew
+// slow ones and nothing ever waits on a lock while there is work left.
+//
+// The threads are kept between runs. They spin for a few tens of microseconds
+// waiting for the next one, since a search that runs level by level starts one
+// every few microseconds, and then sleep on a condition variable until the
+// next search, so a pool between searches uses no CPU; run() takes the mutex
+// only to wake threads that are asleep.
+class WorkPool {
+public:
+  // threads counts the caller, so 1 runs everything on the calling thread
+  explicit WorkPool(int threads)
+    : shares_(std::max(1, threads)), call_(NULL), context_(NULL),
+      generation_(0), active_(0), sleepers_(0), stopping_(false)
+  {
+    for (int i = 1; i < size(); ++i) {
+      threads_.push_back(std::thread(&WorkPool::helper, this, i));
+    }
+  }
+
+  ~WorkPool() {
+    stopping_ = true;
+    wake();
+    for (size_t i = 0; i < threads_.size(); ++i) {
+      threads_[i].join();
+    }
+  }
+
+  int size() const { return (int)shares_.size(); }
+
+  // calls fn(item, thread) for every item from 0 to n-1, with thread from 0
+  // to size()-1 naming the thread it runs on, and returns once all are done
+  template <class F>
+  void run(const int n, F& fn) {
+    if (size() == 1 || n <= 1) {
+      for (int i = 0; i < n; ++i) {
+        fn(i, 0);
+      }
+      return;
+    }
+    call_ = &callItem<F>;
+    context_ = &fn;
+    for (int t = 0; t < size(); ++t) {
+      shares_[t].next.store((int)((long long)n * t / size()), std::memory_order_relaxed);
+      shares_[t].end = (int)((long long)n * (t + 1) / size());
+    }
+    active_.store(size() - 1, std::memory_order_relaxed);
+    wake();
+    work(0);
+    while (active_.load(std::memory_order_acquire) != 0) {
+      std::this_thread::yield();
+    }
+  }
+
+private:
+  static const int SPIN_MICROSECONDS = 50; // a helper waits this long for the next run before sleeping
+
+  // the items one thread starts with; padded so shares don't share a cache line
+  struct Share {
+    std::atomic<int> next;
+    int end;
+    char pad[64 - sizeof(std::atomic<int>) - sizeof(int)];
+
+    Share() : next(0), end(0) {}
+  };
+
+  template <class F>
+  static void callItem(void* context, const int item, const int thread) {
+    (*static_cast<F*>(context))(item, thread);
+  }
+
+  // starts a run (or the shutdown) on every helper
+  void wake() {
+    generation_.fetch_add(1);
+    if (sleepers_.load() > 0) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      wakeup_.notify_all();
+    }
+  }
+
+  // takes items from thread's own share, then from the others'
+  void work(const int thread) {
+    for (int k = 0; k < size(); ++k) {
+      Share& share = shares_[(thread + k) % size()];
+      for (int i; (i = share.next.fetch_add(1, std::memory_order_relaxed)) < share.end;) {
+        call_(context_, i, thread);
+      }
+    }
+  }
+
+  void helper(const int thread) {
+    unsigned seen = 0;
+    for (;;) {
+      const std::chrono::steady_clock::time_point spinEnd =
+        std::chrono::steady_clock::now() + std::chrono::microseconds(int(SPIN_MICROSECONDS));
+      while (generation_.load(std::memory_order_acquire) == seen && std::chrono::steady_clock::now() < spinEnd) {
+        std::this_thread::yield();
+      }
+      if (generation_.load(std::memory_order_acquire) == seen) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        sleepers_.fetch_add(1);
+        while (generation_.load() == seen) {
+          wakeup_.wait(lock);
+        }
+        sleepers_.fetch_sub(1);
+      }
+      seen = generation_.load(std::memory_order_acquire);
+      if (stopping_)
+        return;
+      work(thread);
+      active_.fetch_sub(1, std::memory_order_release);
+    }
+  }
+
+  std::vector<Share> shares_;
+  std::vector<std::thread> threads_;
+  void (*call_)(void*, int, int); // the current run's fn, through callItem
+  void* context_;
+  std::atomic<unsigned> generation_; // runs started, and one more for the shutdown
+  std::atomic<int> active_;          // helpers still working on the current run
+  std::atomic<int> sleepers_;        // helpers waiting on wakeup_
+  std::atomic<bool> stopping_;
+  std::mutex mutex_;
+  std::condition_variable wakeup_;
+};
+
+#endif